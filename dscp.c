@@ -1,175 +1,5129 @@
 #include <stdio.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
-#include <windows.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <errno.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define APSP_SIMD 1
+#endif
 
-#define MAX_NODES 100
+#define INITIAL_NODE_CAPACITY 64
+#define INITIAL_DELTA_CAPACITY 256
 
-typedef struct Edge {
+typedef struct {
+    int source;
     int destination;
     int weight;
-    struct Edge* next;
-} Edge;
+} PendingRoute;
 
-// Adjacency list for the network
-Edge* graph[MAX_NODES];
-int sent_packets[MAX_NODES] = {0};
-int received_packets[MAX_NODES] = {0};
-int nodes = 0;
+// Compressed sparse row adjacency for the network. The routes leaving
+// computer u are destinations/weights[offsets[u] .. ends[u]); a row may keep
+// slack after deletions until the next compaction. New routes go to the
+// delta buffer and are merged into the rows by graph_compact().
+// The incoming index uses the same layout keyed by destination, with
+// destinations[] holding the computers the routes come from; it is kept in
+// step with graph by every change.
+typedef struct {
+    int* offsets;
+    int* ends;
+    int* destinations;
+    int* weights;
+    PendingRoute* delta;
+    int delta_count;
+    int delta_capacity;
+} Graph;
+
+Graph graph;
+Graph incoming;
+atomic_int* sent_packets = NULL;
+atomic_int* received_packets = NULL;
+int nodes = 0;           // slots in use, live or free
+int node_capacity = 0;
+int negative_routes = 0;
+int worker_threads = 1;
+bool quiet = false;     // batch mode: no confirmations for mutations
+
+#define HANDLE_SLOT_BITS 24
+#define HANDLE_SLOT_MASK ((1 << HANDLE_SLOT_BITS) - 1)
+#define HANDLE_GENERATIONS 128
+
+// Slot map behind computer handles. Computers keep their graph index
+// (slot) for life; a handle packs the slot with the slot's generation,
+// which is bumped when the computer is removed, so stale handles stop
+// resolving. Freed slots are reused by later additions.
+typedef struct {
+    int* state;         // per slot: generation << 1, | 1 while a computer lives there
+    int* free_slots;    // stack of free slots below nodes
+    int free_count;
+    int free_capacity;
+    int live;
+} ComputerSlots;
+
+ComputerSlots computers;
+
+#define SIM_PACKET_TIME_MS 5
+#define SIM_PACKET_BYTES 1500
+#define SIM_REPORT_LIMIT 20
+
+typedef struct {
+    int id;
+    int from;
+    int to;
+    int packets;
+    int hops;           // -1 when no route was found
+    int* links;         // route slots in graph, one per hop
+    long long finish;   // simulated time the last packet arrived
+} Transfer;
+
+// Fixed pool of workers that route submitted transfers, fed from a
+// growable ring. Routed transfers wait in batch until they are simulated
+// on the virtual clock (milliseconds).
+typedef struct {
+    bool started;
+    bool stopping;
+    pthread_t* threads;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t idle;
+    Transfer** queue;
+    int head;
+    int count;
+    int capacity;
+    int active;
+    int next_id;
+    Transfer** batch;
+    int batch_count;
+    int batch_capacity;
+    long long clock;
+} TransferEngine;
+
+// A packet of batch[transfer] arriving at hop `hop` of its route.
+typedef struct {
+    long long time;
+    int transfer;
+    int hop;
+} SimEvent;
+
+typedef struct {
+    SimEvent* items;
+    int size;
+    int capacity;
+} EventQueue;
+
+TransferEngine transfers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work_ready = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER
+};
+
+#define HEAP_ARITY 4
+
+// Indexed d-ary min-heap of computers keyed by tentative distance.
+// positions[] maps a computer to its heap slot (-1 when not queued), which
+// lets a relaxation lower the key of an already queued computer in place.
+typedef struct {
+    int* items;
+    int* keys;
+    int* positions;
+    int size;
+    long long operations;   // pushes and pops since init or clear
+} MinHeap;
+
+#define ALT_LANDMARKS 8
+
+// A hierarchy arc: a route or a shortcut to node.
+typedef struct {
+    int node;
+    int weight;
+    int middle;     // contracted computer a shortcut bypasses, -1 for a real route
+} ChArc;
+
+// Contraction hierarchy over the routes. Upward arcs u -> x (rank[x] >
+// rank[u]) are grouped by u; downward arcs u -> x (rank[u] > rank[x]) are
+// grouped by x and point back at u, so both query directions only climb.
+typedef struct {
+    bool valid;
+    int node_count;
+    int shortcut_count;
+    int* rank;
+    int* up_offsets;
+    ChArc* up_arcs;
+    int* down_offsets;
+    ChArc* down_arcs;
+    // Query workspace, reset through the touched list after every query
+    int* forward_distance;
+    int* backward_distance;
+    int* forward_parent;
+    int* backward_parent;
+    int* touched;
+    int touched_count;
+    MinHeap forward_heap;
+    MinHeap backward_heap;
+} ContractionHierarchy;
+
+ContractionHierarchy hierarchy;
+
+// Landmark distances for A* lower bounds, stored node-major:
+// landmark_from[v * landmark_count + k] = d(landmark k, v) and
+// landmark_to[v * landmark_count + k] = d(v, landmark k).
+int landmark_count = 0;
+int* landmark_from = NULL;
+int* landmark_to = NULL;
+bool landmarks_valid = false;
+
+// Johnson potentials h(v) from a Bellman-Ford run off a virtual source, and
+// the reweighted latencies w + h(u) - h(v) laid out like graph.weights.
+int* potentials = NULL;
+int* reweighted = NULL;
+bool potentials_valid = false;
+bool potentials_cycle = false;
+
+#define APSP_TILE 64
+#define APSP_ROW_PAD 16
+#define APSP_INF 0x3FFFFFFF
+
+// Dense all-pairs matrices covering a multiple of APSP_TILE computers. Rows
+// are APSP_ROW_PAD ints longer so tile rows do not alias in the cache.
+// Entries at or above APSP_INF / 2 mean unreachable; previous[i * size + j]
+// is the hop before j on the shortest path from i.
+typedef struct {
+    bool valid;
+    int node_count;
+    int size;
+    int* distance;
+    int* previous;
+} ApspMatrix;
+
+ApspMatrix apsp;
+
+#define PATH_CACHE_BUDGET_MB 64
+
+// Shortest-path tree from one source. Dijkstra and Johnson trees stop at
+// the target that was asked for: keys up to radius (in the search's own,
+// possibly reweighted, terms) are final and anything beyond needs a new
+// search. Bellman-Ford trees are always complete.
+typedef struct PathTree {
+    int source;
+    int algorithm;
+    int radius;
+    int settled;
+    int* distance;
+    int* previous;
+    bool* affected;     // computers hit by a negative cycle, NULL if none
+    int* cycle;
+    int cycle_length;
+    size_t bytes;
+    struct PathTree* newer;
+    struct PathTree* older;
+    struct PathTree* next;      // hash chain
+} PathTree;
+
+// LRU cache of shortest-path trees keyed by (source, algorithm) and bounded
+// by budget bytes. All entries were built at graph_version == version.
+typedef struct {
+    PathTree** buckets;
+    int bucket_count;
+    int count;
+    PathTree* newest;
+    PathTree* oldest;
+    size_t bytes;
+    size_t budget;
+    unsigned long version;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+} PathCache;
+
+PathCache path_cache;
+unsigned long graph_version = 0;
+
+#define DYNAMIC_LOG_LIMIT 4096
+#define DYNAMIC_ORPHAN -2
+
+// Shortest-path tree kept up to date for a watched source. previous[v] is
+// DYNAMIC_ORPHAN when v's parent computer was removed and v awaits repair.
+typedef struct {
+    int source;
+    bool stale;         // rebuild with a full search on the next repair
+    int node_count;     // computers covered by distance/previous
+    int orphan_count;
+    int* distance;
+    int* previous;
+} WatchedTree;
+
+typedef struct {
+    int source;
+    int destination;
+    bool removed;
+} RouteChange;
+
+// Watched sources and the route changes not yet applied to their trees.
+typedef struct {
+    WatchedTree* trees;
+    int count;
+    int capacity;
+    RouteChange* changes;
+    int change_count;
+    int change_capacity;
+    // Repair workspace
+    int workspace_size;
+    bool* affected;
+    int* queue;
+    MinHeap heap;
+} DynamicSssp;
+
+DynamicSssp dynamic;
+
+// The loaded snapshot file, mapped copy-on-write. Arrays of the graph and
+// its indexes may point into it until they are first resized or rebuilt.
+typedef struct {
+    char* base;
+    size_t size;
+} SnapshotMapping;
+
+SnapshotMapping snapshot;
+
+#define METRIC_BUCKETS 24
+#define METRICS_INTERVAL_SECONDS 10
+
+enum {
+    METRIC_DIJKSTRA,
+    METRIC_BELLMAN_FORD,
+    METRIC_BIDIRECTIONAL,
+    METRIC_ASTAR,
+    METRIC_HIERARCHY,
+    METRIC_PARALLEL_BELLMAN_FORD,
+    METRIC_DELTA_STEPPING,
+    METRIC_JOHNSON,
+    METRIC_ALGORITHMS
+};
+
+const char* metric_algorithm_names[METRIC_ALGORITHMS] = {
+    "dijkstra", "bellman_ford", "bidirectional", "astar", "hierarchy",
+    "parallel_bellman_ford", "delta_stepping", "johnson"
+};
+
+// Power-of-two histogram: bucket b below METRIC_BUCKETS - 1 counts
+// observations up to 2^b units, the last bucket everything larger.
+typedef struct {
+    atomic_llong buckets[METRIC_BUCKETS];
+    atomic_llong count;
+    atomic_llong sum;
+} MetricHistogram;
+
+typedef struct {
+    atomic_llong settled;
+    atomic_llong relaxed;
+    atomic_llong heap_operations;
+    MetricHistogram latency;    // microseconds
+} AlgorithmMetrics;
+
+// Counters of one thread. Only the owning thread writes them, with relaxed
+// load/store pairs, and readers add up every block, so counting takes no
+// lock and no locked instruction. A block outlives its thread and is handed
+// to the next thread that starts, so the totals stay intact.
+typedef struct ThreadMetrics {
+    AlgorithmMetrics algorithms[METRIC_ALGORITHMS];
+    MetricHistogram transfer_time;  // simulated milliseconds
+    atomic_llong transfer_packets;
+    atomic_llong transfer_bytes;
+    // Search work done by this thread so far, owner only; a finished query
+    // is charged the difference since its MetricMark
+    long long settled;
+    long long relaxed;
+    long long heap_operations;
+    struct ThreadMetrics* next;
+    struct ThreadMetrics* next_free;
+} ThreadMetrics;
+
+typedef struct {
+    long long started;  // nanoseconds
+    long long settled;
+    long long relaxed;
+    long long heap_operations;
+} MetricMark;
+
+// Every thread's counter block, plus the thread that writes them out in
+// Prometheus text format every interval seconds.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_once_t once;
+    pthread_key_t key;
+    ThreadMetrics* blocks;
+    ThreadMetrics* retired;     // blocks whose thread has exited
+    int block_count;
+    const char* path;
+    int interval;
+    bool dumping;
+    bool stopping;
+    pthread_cond_t wake;
+    pthread_t dumper;
+} MetricsRegistry;
+
+MetricsRegistry metrics = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT,
+    .wake = PTHREAD_COND_INITIALIZER
+};
+_Thread_local ThreadMetrics* thread_metrics = NULL;
+
+// Plain sums of all blocks, as read by display_metrics() and write_metrics().
+typedef struct {
+    long long buckets[METRIC_BUCKETS];
+    long long count;
+    long long sum;
+} HistogramTotals;
+
+typedef struct {
+    long long settled[METRIC_ALGORITHMS];
+    long long relaxed[METRIC_ALGORITHMS];
+    long long heap_operations[METRIC_ALGORITHMS];
+    HistogramTotals latency[METRIC_ALGORITHMS];
+    HistogramTotals transfer_time;
+    long long transfer_packets;
+    long long transfer_bytes;
+    int threads;
+} MetricTotals;
+
+bool snapshot_holds(const void* array) {
+    return snapshot.base && (const char*)array >= snapshot.base &&
+           (const char*)array < snapshot.base + snapshot.size;
+}
+
+// free() for arrays that may live in the snapshot mapping.
+void release_array(void* array) {
+    if (!snapshot_holds(array)) free(array);
+}
+
+void* grow_array(void* array, size_t count, size_t size) {
+    void* resized;
+    if (snapshot_holds(array)) {
+        // Move out of the mapping; the array ends somewhere before its end
+        size_t available = snapshot.base + snapshot.size - (char*)array;
+        resized = malloc(count * size);
+        if (resized) memcpy(resized, array, count * size < available ? count * size : available);
+    } else {
+        resized = realloc(array, count * size);
+    }
+    if (resized == NULL && count > 0) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    return resized;
+}
+
+void ensure_node_capacity(int count) {
+    if (count <= node_capacity) return;
+    int capacity = node_capacity > 0 ? node_capacity : INITIAL_NODE_CAPACITY;
+    while (capacity < count) capacity *= 2;
+
+    graph.offsets = grow_array(graph.offsets, capacity, sizeof(int));
+    graph.ends = grow_array(graph.ends, capacity, sizeof(int));
+    incoming.offsets = grow_array(incoming.offsets, capacity, sizeof(int));
+    incoming.ends = grow_array(incoming.ends, capacity, sizeof(int));
+    sent_packets = grow_array(sent_packets, capacity, sizeof(atomic_int));
+    received_packets = grow_array(received_packets, capacity, sizeof(atomic_int));
+    computers.state = grow_array(computers.state, capacity, sizeof(int));
+    for (int i = node_capacity; i < capacity; i++) {
+        computers.state[i] = 0;
+        graph.offsets[i] = 0;
+        graph.ends[i] = 0;
+        incoming.offsets[i] = 0;
+        incoming.ends[i] = 0;
+        sent_packets[i] = 0;
+        received_packets[i] = 0;
+    }
+    node_capacity = capacity;
+}
+
+bool is_valid_computer(int comp) {
+    return comp >= 0 && comp < nodes && (computers.state[comp] & 1);
+}
+
+// The handle users see for the computer in slot.
+int computer_handle(int slot) {
+    return slot | ((computers.state[slot] >> 1) % HANDLE_GENERATIONS) << HANDLE_SLOT_BITS;
+}
+
+// Slot of the computer a handle names, or -1 if there is none. Handles of
+// removed or renumbered computers are reported as stale.
+int resolve_computer(FILE* out, int handle) {
+    if (handle < 0) return -1;
+    int slot = handle & HANDLE_SLOT_MASK;
+    if (slot >= nodes) return -1;
+    if (!is_valid_computer(slot) || computer_handle(slot) != handle) {
+        fprintf(out, "Computer handle %d is stale.\n", handle);
+        return -1;
+    }
+    return slot;
+}
 
 void initialize_graph() {
-    for (int i = 0; i < MAX_NODES; i++) {
-        graph[i] = NULL;
+    ensure_node_capacity(INITIAL_NODE_CAPACITY);
+    graph.delta_count = 0;
+    incoming.delta_count = 0;
+}
+
+// Merges a delta buffer into its CSR rows. Pending routes are placed in
+// front of the existing ones so each row still lists the newest route first.
+static void compact_rows(Graph* rows) {
+    if (rows->delta_count == 0) return;
+
+    int* offsets = malloc(node_capacity * sizeof(int));
+    int* ends = malloc(node_capacity * sizeof(int));
+    if (!offsets || !ends) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    for (int u = 0; u < nodes; u++) {
+        ends[u] = 0;
+    }
+    for (int i = 0; i < rows->delta_count; i++) {
+        ends[rows->delta[i].source]++;
+    }
+
+    int total = 0;
+    for (int u = 0; u < nodes; u++) {
+        offsets[u] = total;
+        total += ends[u] + (rows->ends[u] - rows->offsets[u]);
+        ends[u] = offsets[u];
+    }
+
+    int* destinations = malloc((total > 0 ? total : 1) * sizeof(int));
+    int* weights = malloc((total > 0 ? total : 1) * sizeof(int));
+    if (!destinations || !weights) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+
+    for (int i = rows->delta_count - 1; i >= 0; i--) {
+        PendingRoute* route = &rows->delta[i];
+        int slot = ends[route->source]++;
+        destinations[slot] = route->destination;
+        weights[slot] = route->weight;
+    }
+    for (int u = 0; u < nodes; u++) {
+        int count = rows->ends[u] - rows->offsets[u];
+        if (count == 0) continue;
+        memcpy(destinations + ends[u], rows->destinations + rows->offsets[u], count * sizeof(int));
+        memcpy(weights + ends[u], rows->weights + rows->offsets[u], count * sizeof(int));
+        ends[u] += count;
+    }
+
+    release_array(rows->offsets);
+    release_array(rows->ends);
+    release_array(rows->destinations);
+    release_array(rows->weights);
+    rows->offsets = offsets;
+    rows->ends = ends;
+    rows->destinations = destinations;
+    rows->weights = weights;
+    rows->delta_count = 0;
+}
+
+void graph_compact() {
+    compact_rows(&graph);
+    compact_rows(&incoming);
+}
+
+// Called after every topology change to drop indexes derived from it.
+void graph_changed() {
+    landmarks_valid = false;
+    hierarchy.valid = false;
+    potentials_valid = false;
+    apsp.valid = false;
+    graph_version++;
+}
+
+static void metrics_retire(void* block) {
+    ThreadMetrics* retired = block;
+    pthread_mutex_lock(&metrics.lock);
+    retired->next_free = metrics.retired;
+    metrics.retired = retired;
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+static void metrics_create_key() {
+    pthread_key_create(&metrics.key, metrics_retire);
+}
+
+// The calling thread's counter block, taken from an exited thread if any.
+static ThreadMetrics* metrics_local() {
+    if (thread_metrics) return thread_metrics;
+    pthread_once(&metrics.once, metrics_create_key);
+    pthread_mutex_lock(&metrics.lock);
+    ThreadMetrics* block = metrics.retired;
+    if (block) {
+        metrics.retired = block->next_free;
+    } else {
+        block = calloc(1, sizeof(ThreadMetrics));
+        if (!block) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        block->next = metrics.blocks;
+        metrics.blocks = block;
+        metrics.block_count++;
+    }
+    pthread_mutex_unlock(&metrics.lock);
+    pthread_setspecific(metrics.key, block);
+    thread_metrics = block;
+    return block;
+}
+
+static inline void metric_add(atomic_llong* counter, long long amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount,
+                          memory_order_relaxed);
+}
+
+static void histogram_observe(MetricHistogram* histogram, long long value) {
+    int bucket = 0;
+    while (bucket < METRIC_BUCKETS - 1 && (1LL << bucket) < value) bucket++;
+    metric_add(&histogram->buckets[bucket], 1);
+    metric_add(&histogram->count, 1);
+    metric_add(&histogram->sum, value);
+}
+
+static long long metrics_clock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Starts timing a query on the calling thread.
+MetricMark metrics_start() {
+    ThreadMetrics* local = metrics_local();
+    return (MetricMark){metrics_clock(), local->settled, local->relaxed, local->heap_operations};
+}
+
+// Adds the work of one search; called once per search, not per step.
+void metrics_work(long long settled, long long relaxed, long long heapOperations) {
+    ThreadMetrics* local = metrics_local();
+    local->settled += settled;
+    local->relaxed += relaxed;
+    local->heap_operations += heapOperations;
+}
+
+// Charges everything since mark to one query of the algorithm.
+void metrics_finish(int algorithm, MetricMark mark) {
+    ThreadMetrics* local = metrics_local();
+    AlgorithmMetrics* counters = &local->algorithms[algorithm];
+    metric_add(&counters->settled, local->settled - mark.settled);
+    metric_add(&counters->relaxed, local->relaxed - mark.relaxed);
+    metric_add(&counters->heap_operations, local->heap_operations - mark.heap_operations);
+    histogram_observe(&counters->latency, (metrics_clock() - mark.started + 999) / 1000);
+}
+
+void metrics_transfer(long long milliseconds, int packets) {
+    ThreadMetrics* local = metrics_local();
+    histogram_observe(&local->transfer_time, milliseconds);
+    metric_add(&local->transfer_packets, packets);
+    metric_add(&local->transfer_bytes, (long long)packets * SIM_PACKET_BYTES);
+}
+
+static void histogram_collect(HistogramTotals* totals, MetricHistogram* histogram) {
+    for (int b = 0; b < METRIC_BUCKETS; b++) {
+        totals->buckets[b] += atomic_load_explicit(&histogram->buckets[b], memory_order_relaxed);
+    }
+    totals->count += atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    totals->sum += atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+}
+
+void metrics_collect(MetricTotals* totals) {
+    memset(totals, 0, sizeof(*totals));
+    pthread_mutex_lock(&metrics.lock);
+    for (ThreadMetrics* block = metrics.blocks; block; block = block->next) {
+        for (int a = 0; a < METRIC_ALGORITHMS; a++) {
+            AlgorithmMetrics* counters = &block->algorithms[a];
+            totals->settled[a] += atomic_load_explicit(&counters->settled, memory_order_relaxed);
+            totals->relaxed[a] += atomic_load_explicit(&counters->relaxed, memory_order_relaxed);
+            totals->heap_operations[a] += atomic_load_explicit(&counters->heap_operations, memory_order_relaxed);
+            histogram_collect(&totals->latency[a], &counters->latency);
+        }
+        histogram_collect(&totals->transfer_time, &block->transfer_time);
+        totals->transfer_packets += atomic_load_explicit(&block->transfer_packets, memory_order_relaxed);
+        totals->transfer_bytes += atomic_load_explicit(&block->transfer_bytes, memory_order_relaxed);
+    }
+    totals->threads = metrics.block_count;
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+// Blocks until no transfer is queued or being routed, so the graph and the
+// packet counter arrays can be changed safely.
+void transfer_wait_idle() {
+    pthread_mutex_lock(&transfers.lock);
+    while (transfers.count > 0 || transfers.active > 0) {
+        pthread_cond_wait(&transfers.idle, &transfers.lock);
+    }
+    pthread_mutex_unlock(&transfers.lock);
+}
+
+static inline bool event_before(const SimEvent* a, const SimEvent* b) {
+    if (a->time != b->time) return a->time < b->time;
+    if (a->transfer != b->transfer) return a->transfer < b->transfer;
+    return a->hop < b->hop;
+}
+
+static void event_push(EventQueue* queue, SimEvent event) {
+    if (queue->size == queue->capacity) {
+        queue->capacity = queue->capacity > 0 ? queue->capacity * 2 : 1024;
+        queue->items = grow_array(queue->items, queue->capacity, sizeof(SimEvent));
+    }
+    int slot = queue->size++;
+    while (slot > 0) {
+        int parent = (slot - 1) / HEAP_ARITY;
+        if (!event_before(&event, &queue->items[parent])) break;
+        queue->items[slot] = queue->items[parent];
+        slot = parent;
+    }
+    queue->items[slot] = event;
+}
+
+static SimEvent event_pop(EventQueue* queue) {
+    SimEvent top = queue->items[0];
+    SimEvent last = queue->items[--queue->size];
+    int size = queue->size;
+    int slot = 0;
+    while (1) {
+        int first = slot * HEAP_ARITY + 1;
+        if (first >= size) break;
+        int end = first + HEAP_ARITY < size ? first + HEAP_ARITY : size;
+        int best = first;
+        for (int child = first + 1; child < end; child++) {
+            if (event_before(&queue->items[child], &queue->items[best])) best = child;
+        }
+        if (!event_before(&queue->items[best], &last)) break;
+        queue->items[slot] = queue->items[best];
+        slot = best;
+    }
+    if (size > 0) queue->items[slot] = last;
+    return top;
+}
+
+static void report_transfers(FILE* out, long long start, long long end, long long packets, long long events,
+                             double seconds) {
+    int count = transfers.batch_count;
+    int failed = 0;
+    long long fastest = LLONG_MAX;
+    long long total = 0;
+    for (int i = 0; i < count; i++) {
+        Transfer* transfer = transfers.batch[i];
+        if (transfer->hops < 0) {
+            failed++;
+            if (count <= SIM_REPORT_LIMIT) {
+                fprintf(out, "Transfer %d: no route from %d to %d.\n", transfer->id,
+                        computer_handle(transfer->from), computer_handle(transfer->to));
+            }
+            continue;
+        }
+        long long elapsed = transfer->finish - start;
+        if (elapsed < fastest) fastest = elapsed;
+        total += elapsed;
+        if (count <= SIM_REPORT_LIMIT) {
+            fprintf(out, "Transfer %d: %d packets from %d to %d over %d hops, completed at +%lldms\n",
+                    transfer->id, transfer->packets, computer_handle(transfer->from), computer_handle(transfer->to),
+                    transfer->hops, elapsed);
+        }
+    }
+
+    long long span = end - start;
+    fprintf(out, "Simulated %d transfers (%lld packets, %d unroutable) in %lldms of network time.\n",
+            count, packets, failed, span);
+    if (count > SIM_REPORT_LIMIT && failed < count) {
+        fprintf(out, "Completion: fastest +%lldms, mean +%.1fms, slowest +%lldms\n",
+                fastest, (double)total / (count - failed), span);
+    }
+    double simulatedSeconds = (span > 0 ? span : 1) / 1000.0;
+    fprintf(out, "Throughput: %.1f transfers/s, %.1f packets/s (simulated)\n",
+            (count - failed) / simulatedSeconds, packets / simulatedSeconds);
+    if (seconds <= 0) seconds = 1e-9;
+    fprintf(out, "Events: %lld processed in %.3fs (%.2fM events/s)\n", events, seconds, events / seconds / 1e6);
+}
+
+// Runs the routed batch to completion on the virtual clock. Every packet
+// starts at its source at the current clock; a link serializes one packet
+// every SIM_PACKET_TIME_MS in arrival order, after which the packet takes
+// the route's latency to reach the next computer. Returns false if there
+// was nothing to simulate.
+bool simulate_transfers(FILE* out) {
+    int count = transfers.batch_count;
+    if (count == 0) return false;
+
+    struct timespec wallStart, wallEnd;
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    int linkSlots = 0;
+    for (int u = 0; u < nodes; u++) {
+        if (graph.ends[u] > linkSlots) linkSlots = graph.ends[u];
+    }
+    long long* linkFree = calloc(linkSlots > 0 ? linkSlots : 1, sizeof(long long));
+    EventQueue events = {0};
+    long long start = transfers.clock;
+    long long end = start;
+    long long packets = 0;
+    long long processed = 0;
+
+    for (int i = 0; i < count; i++) {
+        Transfer* transfer = transfers.batch[i];
+        transfer->finish = start;
+        if (transfer->hops < 0) continue;
+        packets += transfer->packets;
+        atomic_fetch_add_explicit(&sent_packets[transfer->from], transfer->packets, memory_order_relaxed);
+        if (transfer->hops == 0) {
+            atomic_fetch_add_explicit(&received_packets[transfer->to], transfer->packets, memory_order_relaxed);
+            continue;
+        }
+        for (int p = 0; p < transfer->packets; p++) {
+            event_push(&events, (SimEvent){start, i, 0});
+        }
+    }
+
+    while (events.size > 0) {
+        SimEvent event = event_pop(&events);
+        processed++;
+        Transfer* transfer = transfers.batch[event.transfer];
+        int link = transfer->links[event.hop];
+        long long depart = event.time > linkFree[link] ? event.time : linkFree[link];
+        linkFree[link] = depart + SIM_PACKET_TIME_MS;
+        event.time = depart + SIM_PACKET_TIME_MS + graph.weights[link];
+        if (++event.hop < transfer->hops) {
+            event_push(&events, event);
+        } else {
+            // Delivery touches nothing else, so it needs no event of its own
+            atomic_fetch_add_explicit(&received_packets[transfer->to], 1, memory_order_relaxed);
+            if (event.time > transfer->finish) transfer->finish = event.time;
+            if (event.time > end) end = event.time;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+    double seconds = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+    for (int i = 0; i < count; i++) {
+        Transfer* transfer = transfers.batch[i];
+        if (transfer->hops >= 0) metrics_transfer(transfer->finish - start, transfer->packets);
+    }
+    report_transfers(out, start, end, packets, processed, seconds);
+
+    transfers.clock = end;
+    for (int i = 0; i < count; i++) {
+        free(transfers.batch[i]->links);
+        free(transfers.batch[i]);
+    }
+    transfers.batch_count = 0;
+    free(events.items);
+    free(linkFree);
+    return true;
+}
+
+// Finishes routing and simulating submitted transfers. Topology changes
+// call this first because routes refer to the current route slots.
+void transfer_quiesce(FILE* out) {
+    transfer_wait_idle();
+    simulate_transfers(out);
+}
+
+void dynamic_mark_stale() {
+    for (int i = 0; i < dynamic.count; i++) {
+        dynamic.trees[i].stale = true;
+    }
+    dynamic.change_count = 0;
+}
+
+// Logs a route change for the watched trees to repair on their next use.
+// A log that outgrows DYNAMIC_LOG_LIMIT is cheaper to replace by full
+// searches.
+void dynamic_record(int u, int v, bool removed) {
+    if (dynamic.count == 0) return;
+    if (dynamic.change_count == DYNAMIC_LOG_LIMIT) {
+        dynamic_mark_stale();
+    }
+    if (dynamic.change_count == dynamic.change_capacity) {
+        dynamic.change_capacity = dynamic.change_capacity > 0 ? dynamic.change_capacity * 2 : 64;
+        dynamic.changes = grow_array(dynamic.changes, dynamic.change_capacity, sizeof(RouteChange));
+    }
+    RouteChange* change = &dynamic.changes[dynamic.change_count++];
+    change->source = u;
+    change->destination = v;
+    change->removed = removed;
+}
+
+// Drops comp from the watched trees and pending changes. Computers whose
+// tree parent was comp become orphans for the next repair.
+void dynamic_remove_computer(FILE* out, int comp) {
+    int kept = 0;
+    for (int i = 0; i < dynamic.change_count; i++) {
+        RouteChange change = dynamic.changes[i];
+        if (change.source == comp || change.destination == comp) continue;
+        dynamic.changes[kept++] = change;
+    }
+    dynamic.change_count = kept;
+
+    kept = 0;
+    for (int i = 0; i < dynamic.count; i++) {
+        WatchedTree tree = dynamic.trees[i];
+        if (tree.source == comp) {
+            free(tree.distance);
+            free(tree.previous);
+            fprintf(out, "Stopped watching computer %d.\n", computer_handle(comp));
+            continue;
+        }
+        if (!tree.stale && comp < tree.node_count) {
+            tree.distance[comp] = INT_MAX;
+            tree.previous[comp] = -1;
+            for (int v = 0; v < tree.node_count; v++) {
+                if (tree.previous[v] == comp) {
+                    tree.previous[v] = DYNAMIC_ORPHAN;
+                    tree.orphan_count++;
+                }
+            }
+        }
+        dynamic.trees[kept++] = tree;
+    }
+    dynamic.count = kept;
+}
+
+void dynamic_clear() {
+    for (int i = 0; i < dynamic.count; i++) {
+        free(dynamic.trees[i].distance);
+        free(dynamic.trees[i].previous);
+    }
+    dynamic.count = 0;
+    dynamic.change_count = 0;
+}
+
+// Brings a computer up in slot, which is free or equal to nodes.
+static void open_slot(int slot) {
+    ensure_node_capacity(slot + 1);
+    graph.offsets[slot] = 0;
+    graph.ends[slot] = 0;
+    incoming.offsets[slot] = 0;
+    incoming.ends[slot] = 0;
+    sent_packets[slot] = 0;
+    received_packets[slot] = 0;
+    computers.state[slot] |= 1;
+    computers.live++;
+    if (slot == nodes) nodes++;
+}
+
+// Adds a computer in a freed slot if there is one, else in a new slot.
+int add_computer(FILE* out) {
+    transfer_quiesce(out);
+    int slot = computers.free_count > 0 ? computers.free_slots[--computers.free_count] : nodes;
+    open_slot(slot);
+    graph_changed();
+    if (!quiet) fprintf(out, "Computer %d added to the network.\n", computer_handle(slot));
+    return slot;
+}
+
+// Removes the entries of row u that point at v and returns how many there
+// were; negative ones are subtracted from negative_routes when asked to.
+static int drop_row_entries(Graph* rows, int u, int v, bool countNegative) {
+    int removed = 0;
+    int e = rows->offsets[u];
+    while (e < rows->ends[u]) {
+        if (rows->destinations[e] == v) {
+            if (countNegative && rows->weights[e] < 0) negative_routes--;
+            rows->ends[u]--;
+            rows->destinations[e] = rows->destinations[rows->ends[u]];
+            rows->weights[e] = rows->weights[rows->ends[u]];
+            removed++;
+        } else {
+            e++;
+        }
+    }
+    return removed;
+}
+
+static void push_pending(Graph* rows, int u, int v, int weight) {
+    if (rows->delta_count == rows->delta_capacity) {
+        rows->delta_capacity = rows->delta_capacity > 0 ? rows->delta_capacity * 2 : INITIAL_DELTA_CAPACITY;
+        rows->delta = grow_array(rows->delta, rows->delta_capacity, sizeof(PendingRoute));
+    }
+    PendingRoute* route = &rows->delta[rows->delta_count++];
+    route->source = u;
+    route->destination = v;
+    route->weight = weight;
+}
+
+// Removes comp in place. Through the incoming index only the rows of
+// computers adjacent to comp are touched; its slot gets a new generation
+// and is queued for reuse, and every other computer keeps its handle.
+void remove_computer(FILE* out, int comp) {
+    if (is_valid_computer(comp)) {
+        transfer_quiesce(out);
+        graph_compact();
+        int handle = computer_handle(comp);
+
+        for (int e = graph.offsets[comp]; e < graph.ends[comp]; e++) {
+            if (graph.weights[e] < 0) negative_routes--;
+            drop_row_entries(&incoming, graph.destinations[e], comp, false);
+        }
+        for (int e = incoming.offsets[comp]; e < incoming.ends[comp]; e++) {
+            drop_row_entries(&graph, incoming.destinations[e], comp, true);
+        }
+        graph.offsets[comp] = graph.ends[comp] = 0;
+        incoming.offsets[comp] = incoming.ends[comp] = 0;
+        sent_packets[comp] = 0;
+        received_packets[comp] = 0;
+        dynamic_remove_computer(out, comp);
+
+        computers.state[comp] = (computers.state[comp] & ~1) + 2;
+        computers.live--;
+        if (computers.free_count == computers.free_capacity) {
+            computers.free_capacity = computers.free_capacity > 0 ? computers.free_capacity * 2 : 64;
+            computers.free_slots = grow_array(computers.free_slots, computers.free_capacity, sizeof(int));
+        }
+        computers.free_slots[computers.free_count++] = comp;
+        graph_changed();
+        if (!quiet) fprintf(out, "Computer %d removed from the network.\n", handle);
+    } else {
+        fprintf(out, "Invalid computer index!\n");
+    }
+}
+
+void add_route(FILE* out, int u, int v, int weight) {
+    if (is_valid_computer(u) && is_valid_computer(v) && u != v) {
+        transfer_quiesce(out);
+        // Add only forward edge (directed graph)
+        push_pending(&graph, u, v, weight);
+        push_pending(&incoming, v, u, weight);
+        if (weight < 0) negative_routes++;
+        dynamic_record(u, v, false);
+        graph_changed();
+
+        if (!quiet) fprintf(out, "Route added: %d -> %d with latency %dms.\n", computer_handle(u),
+                            computer_handle(v), weight);
+    } else {
+        fprintf(out, "Invalid computers!\n");
+    }
+}
+
+// Removes every route from u to v.
+void remove_route(FILE* out, int u, int v) {
+    if (!is_valid_computer(u) || !is_valid_computer(v)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+    transfer_quiesce(out);
+    graph_compact();
+
+    int removed = drop_row_entries(&graph, u, v, true);
+    if (removed == 0) {
+        fprintf(out, "No route from %d to %d.\n", computer_handle(u), computer_handle(v));
+        return;
+    }
+    drop_row_entries(&incoming, v, u, false);
+    dynamic_record(u, v, true);
+    graph_changed();
+    if (!quiet) fprintf(out, "Route removed: %d -> %d (%d route%s).\n", computer_handle(u), computer_handle(v),
+                        removed, removed == 1 ? "" : "s");
+}
+
+// Renumbers the live computers into slots 0 .. live - 1, keeping their
+// order, so traversals stop skipping over freed slots. Every slot from the
+// first hole on gets a new generation: handles of moved computers go
+// stale, the others stay valid.
+void compact_computers(FILE* out) {
+    transfer_quiesce(out);
+    if (computers.free_count == 0) {
+        fprintf(out, "Computers are already numbered densely.\n");
+        return;
+    }
+    graph_compact();
+
+    int* slotOf = malloc(nodes * sizeof(int));
+    int live = 0;
+    int firstHole = -1;
+    for (int s = 0; s < nodes; s++) {
+        if (is_valid_computer(s)) {
+            slotOf[s] = live++;
+        } else {
+            slotOf[s] = -1;
+            if (firstHole == -1) firstHole = s;
+        }
+    }
+    Graph* rowSets[2] = {&graph, &incoming};
+    for (int r = 0; r < 2; r++) {
+        Graph* rows = rowSets[r];
+        for (int s = 0; s < nodes; s++) {
+            if (slotOf[s] == -1) continue;
+            for (int e = rows->offsets[s]; e < rows->ends[s]; e++) {
+                rows->destinations[e] = slotOf[rows->destinations[e]];
+            }
+            rows->offsets[slotOf[s]] = rows->offsets[s];
+            rows->ends[slotOf[s]] = rows->ends[s];
+        }
+    }
+    for (int s = 0; s < nodes; s++) {
+        if (slotOf[s] != -1) {
+            sent_packets[slotOf[s]] = atomic_load(&sent_packets[s]);
+            received_packets[slotOf[s]] = atomic_load(&received_packets[s]);
+        }
+    }
+    for (int s = firstHole; s < nodes; s++) {
+        computers.state[s] = ((computers.state[s] >> 1) + 1) << 1 | (s < live);
+        if (s >= live) {
+            graph.offsets[s] = graph.ends[s] = 0;
+            incoming.offsets[s] = incoming.ends[s] = 0;
+            sent_packets[s] = 0;
+            received_packets[s] = 0;
+        }
+    }
+
+    // Watched trees are rebuilt under the new numbering
+    for (int i = 0; i < dynamic.count; i++) {
+        WatchedTree* tree = &dynamic.trees[i];
+        tree->source = slotOf[tree->source];
+        tree->stale = true;
+        if (tree->node_count > live) tree->node_count = live;
+    }
+    dynamic.change_count = 0;
+
+    int moved = nodes - firstHole - computers.free_count;
+    free(slotOf);
+    nodes = live;
+    computers.free_count = 0;
+    graph_changed();
+    fprintf(out, "Computers renumbered: %d live, %d moved to new handles.\n", live, moved);
+}
+
+void display_network(FILE* out) {
+    graph_compact();
+    fprintf(out, "\nCurrent Network:\n");
+    for (int i = 0; i < nodes; i++) {
+        if (!is_valid_computer(i)) continue;
+        fprintf(out, "Computer %d -> ", computer_handle(i));
+        for (int e = graph.offsets[i]; e < graph.ends[i]; e++) {
+            fprintf(out, "%d(%dms) ", computer_handle(graph.destinations[e]), graph.weights[e]);
+        }
+        fprintf(out, "| Sent: %d | Received: %d\n", atomic_load(&sent_packets[i]), atomic_load(&received_packets[i]));
+    }
+}
+
+bool has_negative_weights() {
+    return negative_routes > 0;
+}
+
+
+void print_path(FILE* out, int start, int end, const int* distance, const int* previous) {
+    if (distance[end] == INT_MAX) {
+        fprintf(out, "\nNo path from %d to %d found.\n", computer_handle(start), computer_handle(end));
+        return;
+    }
+
+    fprintf(out, "\nShortest path from %d to %d: %dms\n", computer_handle(start), computer_handle(end), distance[end]);
+    fprintf(out, "Path: ");
+    int current = end;
+    while (current != -1) {
+        fprintf(out, "%d <- ", computer_handle(current));
+        current = previous[current];
+    }
+    fprintf(out, "END\n");
+}
+
+void heap_init(MinHeap* heap, int capacity) {
+    heap->items = malloc(capacity * sizeof(int));
+    heap->keys = malloc(capacity * sizeof(int));
+    heap->positions = malloc(capacity * sizeof(int));
+    if (capacity > 0 && (!heap->items || !heap->keys || !heap->positions)) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    for (int i = 0; i < capacity; i++) {
+        heap->positions[i] = -1;
+    }
+    heap->size = 0;
+    heap->operations = 0;
+}
+
+// Empties the heap in O(size) so a workspace heap can be reused.
+void heap_clear(MinHeap* heap) {
+    for (int i = 0; i < heap->size; i++) {
+        heap->positions[heap->items[i]] = -1;
+    }
+    heap->size = 0;
+    heap->operations = 0;
+}
+
+void heap_free(MinHeap* heap) {
+    free(heap->items);
+    free(heap->keys);
+    free(heap->positions);
+}
+
+static void heap_sift_up(MinHeap* heap, int slot, int node, int key) {
+    while (slot > 0) {
+        int parent = (slot - 1) / HEAP_ARITY;
+        if (heap->keys[parent] <= key) break;
+        heap->items[slot] = heap->items[parent];
+        heap->keys[slot] = heap->keys[parent];
+        heap->positions[heap->items[slot]] = slot;
+        slot = parent;
+    }
+    heap->items[slot] = node;
+    heap->keys[slot] = key;
+    heap->positions[node] = slot;
+}
+
+// Queues node with the given key, or lowers its key if it is already queued.
+void heap_push(MinHeap* heap, int node, int key) {
+    int slot = heap->positions[node];
+    if (slot == -1) {
+        slot = heap->size++;
+    } else if (heap->keys[slot] <= key) {
+        return;
+    }
+    heap->operations++;
+    heap_sift_up(heap, slot, node, key);
+}
+
+static void heap_sift_down(MinHeap* heap, int slot, int node, int key) {
+    int size = heap->size;
+    while (1) {
+        int first = slot * HEAP_ARITY + 1;
+        if (first >= size) break;
+        int last = first + HEAP_ARITY < size ? first + HEAP_ARITY : size;
+        int best = first;
+        for (int child = first + 1; child < last; child++) {
+            if (heap->keys[child] < heap->keys[best]) best = child;
+        }
+        if (heap->keys[best] >= key) break;
+        heap->items[slot] = heap->items[best];
+        heap->keys[slot] = heap->keys[best];
+        heap->positions[heap->items[slot]] = slot;
+        slot = best;
+    }
+    heap->items[slot] = node;
+    heap->keys[slot] = key;
+    heap->positions[node] = slot;
+}
+
+int heap_pop(MinHeap* heap, int* key) {
+    int top = heap->items[0];
+    if (key) *key = heap->keys[0];
+    heap->positions[top] = -1;
+    heap->operations++;
+
+    int size = --heap->size;
+    if (size > 0) {
+        heap_sift_down(heap, 0, heap->items[size], heap->keys[size]);
+    }
+    return top;
+}
+
+// Heap-based Dijkstra from start over the rows [offsets[u], ends[u]) of an
+// adjacency of count computers with non-negative weights. The search stops
+// as soon as target is settled; pass target = -1 for the full tree. Returns
+// the number of computers settled.
+int heap_search(int count, const int* offsets, const int* ends, const int* targets, const int* weights,
+                int start, int target, int* distance, int* previous) {
+    for (int i = 0; i < count; i++) {
+        distance[i] = INT_MAX;
+        previous[i] = -1;
+    }
+
+    MinHeap heap;
+    heap_init(&heap, count);
+    distance[start] = 0;
+    heap_push(&heap, start, 0);
+
+    int settled = 0;
+    long long relaxed = 0;
+    while (heap.size > 0) {
+        int d;
+        int u = heap_pop(&heap, &d);
+        settled++;
+        if (u == target) break;
+
+        relaxed += ends[u] - offsets[u];
+        for (int e = offsets[u]; e < ends[u]; e++) {
+            int v = targets[e];
+            int candidate = d + weights[e];
+            if (candidate < distance[v]) {
+                distance[v] = candidate;
+                previous[v] = u;
+                heap_push(&heap, v, candidate);
+            }
+        }
+    }
+
+    metrics_work(settled, relaxed, heap.operations);
+    heap_free(&heap);
+    return settled;
+}
+
+int dijkstra_search(int start, int target, int* distance, int* previous) {
+    graph_compact();
+    MetricMark mark = metrics_start();
+    int settled = heap_search(nodes, graph.offsets, graph.ends, graph.destinations, graph.weights,
+                              start, target, distance, previous);
+    metrics_finish(METRIC_DIJKSTRA, mark);
+    return settled;
+}
+
+// Backward counterpart of dijkstra_search(): distance[v] becomes d(v, start)
+// and next[v] the hop after v on that path.
+int reverse_dijkstra_search(int start, int target, int* distance, int* next) {
+    graph_compact();
+    return heap_search(nodes, incoming.offsets, incoming.ends, incoming.destinations, incoming.weights,
+                       start, target, distance, next);
+}
+
+// Alternates a forward search from start and a backward search from end
+// and stops once the two frontiers can no longer improve the best meeting
+// point. Fills distance/previous like dijkstra_search() for the end node.
+int bidirectional_search(int start, int end, int* distance, int* previous) {
+    graph_compact();
+    MetricMark mark = metrics_start();
+    int* backDistance = malloc(nodes * sizeof(int));
+    int* next = malloc(nodes * sizeof(int));
+    for (int i = 0; i < nodes; i++) {
+        distance[i] = INT_MAX;
+        previous[i] = -1;
+        backDistance[i] = INT_MAX;
+        next[i] = -1;
+    }
+
+    MinHeap forward, backward;
+    heap_init(&forward, nodes);
+    heap_init(&backward, nodes);
+    distance[start] = 0;
+    backDistance[end] = 0;
+    heap_push(&forward, start, 0);
+    heap_push(&backward, end, 0);
+
+    int best = start == end ? 0 : INT_MAX;
+    int meet = start == end ? start : -1;
+    int settled = 0;
+    long long relaxed = 0;
+    while (forward.size > 0 && backward.size > 0) {
+        if (best != INT_MAX && (long long)forward.keys[0] + backward.keys[0] >= best) break;
+
+        bool expandForward = forward.keys[0] <= backward.keys[0];
+        MinHeap* heap = expandForward ? &forward : &backward;
+        int* dist = expandForward ? distance : backDistance;
+        int* other = expandForward ? backDistance : distance;
+        int* link = expandForward ? previous : next;
+        const Graph* rows = expandForward ? &graph : &incoming;
+        const int* offsets = rows->offsets;
+        const int* ends = rows->ends;
+        const int* targets = rows->destinations;
+        const int* weights = rows->weights;
+
+        int d;
+        int u = heap_pop(heap, &d);
+        settled++;
+        relaxed += ends[u] - offsets[u];
+        for (int e = offsets[u]; e < ends[u]; e++) {
+            int v = targets[e];
+            int candidate = d + weights[e];
+            if (candidate < dist[v]) {
+                dist[v] = candidate;
+                link[v] = u;
+                heap_push(heap, v, candidate);
+            }
+            if (other[v] != INT_MAX && (long long)dist[v] + other[v] < best) {
+                best = dist[v] + other[v];
+                meet = v;
+            }
+        }
+    }
+
+    // Splice the backward half onto the forward predecessors
+    if (meet != -1) {
+        for (int v = meet; next[v] != -1; v = next[v]) {
+            previous[next[v]] = v;
+        }
+        distance[end] = best;
+    } else {
+        distance[end] = INT_MAX;
+    }
+
+    metrics_work(settled, relaxed, forward.operations + backward.operations);
+    metrics_finish(METRIC_BIDIRECTIONAL, mark);
+    heap_free(&forward);
+    heap_free(&backward);
+    free(backDistance);
+    free(next);
+    return settled;
+}
+
+// Picks up to ALT_LANDMARKS computers with the farthest-first heuristic and
+// stores their forward and backward distances to every computer.
+void ensure_landmarks() {
+    if (landmarks_valid) return;
+    graph_compact();
+
+    int count = nodes < ALT_LANDMARKS ? nodes : ALT_LANDMARKS;
+    release_array(landmark_from);
+    release_array(landmark_to);
+    landmark_from = malloc((size_t)nodes * count * sizeof(int) + 1);
+    landmark_to = malloc((size_t)nodes * count * sizeof(int) + 1);
+    int* distance = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    int* scratch = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    int* nearest = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    if (!landmark_from || !landmark_to || !distance || !scratch || !nearest) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    for (int v = 0; v < nodes; v++) {
+        nearest[v] = INT_MAX;
+    }
+
+    int landmark = 0;
+    while (landmark < nodes - 1 && !is_valid_computer(landmark)) landmark++;
+    for (int k = 0; k < count; k++) {
+        dijkstra_search(landmark, -1, distance, scratch);
+        for (int v = 0; v < nodes; v++) {
+            landmark_from[v * count + k] = distance[v];
+            if (distance[v] < nearest[v]) nearest[v] = distance[v];
+        }
+        reverse_dijkstra_search(landmark, -1, distance, scratch);
+        for (int v = 0; v < nodes; v++) {
+            landmark_to[v * count + k] = distance[v];
+            if (distance[v] < nearest[v]) nearest[v] = distance[v];
+        }
+
+        // Next landmark: the computer farthest from all chosen ones, with
+        // computers unreachable so far preferred so every region gets one
+        int farthest = -1;
+        for (int v = 0; v < nodes; v++) {
+            if (nearest[v] == 0 || !is_valid_computer(v)) continue;
+            if (farthest == -1 || nearest[v] > nearest[farthest]) farthest = v;
+        }
+        if (farthest == -1) {
+            count = k + 1;
+            break;
+        }
+        landmark = farthest;
+    }
+
+    // Repack if the loop ran out of distinct landmarks early
+    if (count < (nodes < ALT_LANDMARKS ? nodes : ALT_LANDMARKS)) {
+        int stride = nodes < ALT_LANDMARKS ? nodes : ALT_LANDMARKS;
+        for (int v = 0; v < nodes; v++) {
+            for (int k = 0; k < count; k++) {
+                landmark_from[v * count + k] = landmark_from[v * stride + k];
+                landmark_to[v * count + k] = landmark_to[v * stride + k];
+            }
+        }
+    }
+
+    free(distance);
+    free(scratch);
+    free(nearest);
+    landmark_count = count;
+    landmarks_valid = true;
+}
+
+// ALT lower bound on d(v, end) from the triangle inequality at each landmark
+static int landmark_bound(int v, int end) {
+    const int* fromV = landmark_from + v * landmark_count;
+    const int* fromEnd = landmark_from + end * landmark_count;
+    const int* toV = landmark_to + v * landmark_count;
+    const int* toEnd = landmark_to + end * landmark_count;
+    int bound = 0;
+    for (int k = 0; k < landmark_count; k++) {
+        if (fromV[k] != INT_MAX && fromEnd[k] != INT_MAX && fromEnd[k] - fromV[k] > bound) {
+            bound = fromEnd[k] - fromV[k];
+        }
+        if (toV[k] != INT_MAX && toEnd[k] != INT_MAX && toV[k] - toEnd[k] > bound) {
+            bound = toV[k] - toEnd[k];
+        }
+    }
+    return bound;
+}
+
+// A* guided by landmark lower bounds; the bounds are consistent, so a
+// computer is final when popped and the search stops at end.
+int astar_search(int start, int end, int* distance, int* previous) {
+    ensure_landmarks();
+    MetricMark mark = metrics_start();
+    for (int i = 0; i < nodes; i++) {
+        distance[i] = INT_MAX;
+        previous[i] = -1;
+    }
+
+    MinHeap heap;
+    heap_init(&heap, nodes);
+    distance[start] = 0;
+    heap_push(&heap, start, landmark_bound(start, end));
+
+    int settled = 0;
+    long long relaxed = 0;
+    while (heap.size > 0) {
+        int u = heap_pop(&heap, NULL);
+        settled++;
+        if (u == end) break;
+
+        relaxed += graph.ends[u] - graph.offsets[u];
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            int v = graph.destinations[e];
+            int candidate = distance[u] + graph.weights[e];
+            if (candidate < distance[v]) {
+                distance[v] = candidate;
+                previous[v] = u;
+                heap_push(&heap, v, candidate + landmark_bound(v, end));
+            }
+        }
+    }
+
+    metrics_work(settled, relaxed, heap.operations);
+    metrics_finish(METRIC_ASTAR, mark);
+    heap_free(&heap);
+    return settled;
+}
+
+void point_to_point(FILE* out, int start, int end, int mode) {
+    if (!is_valid_computer(start) || !is_valid_computer(end)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+    if (has_negative_weights()) {
+        fprintf(out, "\n⚠️  ALGORITHM ERROR\n");
+        fprintf(out, "=====================================\n");
+        fprintf(out, "%s cannot be used with negative edge weights.\n",
+                mode == 3 ? "Bidirectional Dijkstra" : "A* search");
+        fprintf(out, "Please use Bellman-Ford algorithm instead.\n");
+        fprintf(out, "=====================================\n");
+        return;
+    }
+
+    int* distance = malloc(nodes * sizeof(int));
+    int* previous = malloc(nodes * sizeof(int));
+    int settled = mode == 3 ? bidirectional_search(start, end, distance, previous)
+                            : astar_search(start, end, distance, previous);
+    print_path(out, start, end, distance, previous);
+    fprintf(out, "Computers settled: %d\n", settled);
+    free(distance);
+    free(previous);
+}
+
+#define CH_WITNESS_SETTLE_LIMIT 50
+
+typedef struct {
+    ChArc* arcs;
+    int count;
+    int capacity;
+} ChArcList;
+
+// Overlay graph used while contracting. Once a computer is contracted it is
+// unlinked from its neighbours, and its own lists are frozen as its upward
+// (out) and downward (in) arcs.
+typedef struct {
+    ChArcList* out;
+    ChArcList* in;
+    int* deleted_neighbors;
+    int* witness_distance;
+    int* touched;
+    int touched_count;
+    MinHeap witness_heap;
+} ChBuilder;
+
+static void ch_list_upsert(ChArcList* list, int node, int weight, int middle) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->arcs[i].node == node) {
+            if (weight < list->arcs[i].weight) {
+                list->arcs[i].weight = weight;
+                list->arcs[i].middle = middle;
+            }
+            return;
+        }
+    }
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity > 0 ? list->capacity * 2 : 4;
+        list->arcs = grow_array(list->arcs, list->capacity, sizeof(ChArc));
+    }
+    list->arcs[list->count].node = node;
+    list->arcs[list->count].weight = weight;
+    list->arcs[list->count].middle = middle;
+    list->count++;
+}
+
+static void ch_list_remove(ChArcList* list, int node) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->arcs[i].node == node) {
+            list->arcs[i] = list->arcs[--list->count];
+            return;
+        }
+    }
+}
+
+static void ch_add_arc(ChBuilder* builder, int u, int x, int weight, int middle) {
+    ch_list_upsert(&builder->out[u], x, weight, middle);
+    ch_list_upsert(&builder->in[x], u, weight, middle);
+}
+
+// Bounded Dijkstra from source that avoids the computer being contracted
+static void ch_witness_search(ChBuilder* builder, int source, int skip, int maxCost) {
+    for (int i = 0; i < builder->touched_count; i++) {
+        builder->witness_distance[builder->touched[i]] = INT_MAX;
+    }
+    builder->touched_count = 0;
+    heap_clear(&builder->witness_heap);
+
+    builder->witness_distance[source] = 0;
+    builder->touched[builder->touched_count++] = source;
+    heap_push(&builder->witness_heap, source, 0);
+
+    int settled = 0;
+    while (builder->witness_heap.size > 0 && settled < CH_WITNESS_SETTLE_LIMIT) {
+        int d;
+        int u = heap_pop(&builder->witness_heap, &d);
+        if (d > maxCost) break;
+        settled++;
+
+        ChArcList* out = &builder->out[u];
+        for (int i = 0; i < out->count; i++) {
+            int v = out->arcs[i].node;
+            if (v == skip) continue;
+            int candidate = d + out->arcs[i].weight;
+            if (candidate < builder->witness_distance[v]) {
+                if (builder->witness_distance[v] == INT_MAX) {
+                    builder->touched[builder->touched_count++] = v;
+                }
+                builder->witness_distance[v] = candidate;
+                heap_push(&builder->witness_heap, v, candidate);
+            }
+        }
+    }
+}
+
+// Counts the shortcuts contracting v would need, adding them when apply is
+// set, and returns v's edge-difference priority.
+static int ch_contract(ChBuilder* builder, int v, bool apply) {
+    ChArcList* in = &builder->in[v];
+    ChArcList* out = &builder->out[v];
+    int maxOut = 0, inDegree = 0, outDegree = 0;
+    for (int j = 0; j < out->count; j++) {
+        outDegree++;
+        if (out->arcs[j].weight > maxOut) maxOut = out->arcs[j].weight;
+    }
+
+    int shortcuts = 0;
+    for (int i = 0; i < in->count; i++) {
+        int u = in->arcs[i].node;
+        inDegree++;
+        int w1 = in->arcs[i].weight;
+        ch_witness_search(builder, u, v, w1 + maxOut);
+
+        for (int j = 0; j < out->count; j++) {
+            int x = out->arcs[j].node;
+            if (x == u) continue;
+            int cost = w1 + out->arcs[j].weight;
+            if (builder->witness_distance[x] <= cost) continue;
+            shortcuts++;
+            if (apply) ch_add_arc(builder, u, x, cost, v);
+        }
+    }
+    return shortcuts - inDegree - outDegree + builder->deleted_neighbors[v];
+}
+
+static void ch_free_query_workspace() {
+    free(hierarchy.rank);
+    free(hierarchy.up_offsets);
+    free(hierarchy.up_arcs);
+    free(hierarchy.down_offsets);
+    free(hierarchy.down_arcs);
+    free(hierarchy.forward_distance);
+    free(hierarchy.backward_distance);
+    free(hierarchy.forward_parent);
+    free(hierarchy.backward_parent);
+    free(hierarchy.touched);
+    if (hierarchy.node_count > 0) {
+        heap_free(&hierarchy.forward_heap);
+        heap_free(&hierarchy.backward_heap);
+    }
+    memset(&hierarchy, 0, sizeof(hierarchy));
+}
+
+// Orders computers by lazily updated edge difference, contracts them one by
+// one, and stores the resulting upward/downward arcs in CSR form.
+void build_hierarchy(FILE* out) {
+    if (has_negative_weights()) {
+        fprintf(out, "Route hierarchy requires non-negative latencies.\n");
+        return;
+    }
+    graph_compact();
+    ch_free_query_workspace();
+
+    int n = nodes;
+    int size = n > 0 ? n : 1;
+    ChBuilder builder;
+    builder.out = calloc(size, sizeof(ChArcList));
+    builder.in = calloc(size, sizeof(ChArcList));
+    builder.deleted_neighbors = calloc(size, sizeof(int));
+    builder.witness_distance = malloc(size * sizeof(int));
+    builder.touched = malloc(size * sizeof(int));
+    builder.touched_count = 0;
+    heap_init(&builder.witness_heap, n);
+    hierarchy.rank = malloc(size * sizeof(int));
+    for (int v = 0; v < n; v++) {
+        builder.witness_distance[v] = INT_MAX;
+    }
+
+    for (int u = 0; u < n; u++) {
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            ch_add_arc(&builder, u, graph.destinations[e], graph.weights[e], -1);
+        }
+    }
+
+    MinHeap order;
+    heap_init(&order, n);
+    for (int v = 0; v < n; v++) {
+        heap_push(&order, v, ch_contract(&builder, v, false));
+    }
+
+    int nextRank = 0;
+    while (order.size > 0) {
+        int v = heap_pop(&order, NULL);
+        int priority = ch_contract(&builder, v, false);
+        if (order.size > 0 && priority > order.keys[0]) {
+            heap_push(&order, v, priority);
+            continue;
+        }
+
+        ch_contract(&builder, v, true);
+        hierarchy.rank[v] = nextRank++;
+        for (int i = 0; i < builder.out[v].count; i++) {
+            int x = builder.out[v].arcs[i].node;
+            ch_list_remove(&builder.in[x], v);
+            builder.deleted_neighbors[x]++;
+        }
+        for (int i = 0; i < builder.in[v].count; i++) {
+            int u = builder.in[v].arcs[i].node;
+            ch_list_remove(&builder.out[u], v);
+            builder.deleted_neighbors[u]++;
+        }
+    }
+    heap_free(&order);
+
+    hierarchy.up_offsets = malloc((n + 1) * sizeof(int));
+    hierarchy.down_offsets = malloc((n + 1) * sizeof(int));
+    hierarchy.up_offsets[0] = 0;
+    hierarchy.down_offsets[0] = 0;
+    for (int v = 0; v < n; v++) {
+        hierarchy.up_offsets[v + 1] = hierarchy.up_offsets[v] + builder.out[v].count;
+        hierarchy.down_offsets[v + 1] = hierarchy.down_offsets[v] + builder.in[v].count;
+    }
+    hierarchy.up_arcs = malloc((hierarchy.up_offsets[n] + 1) * sizeof(ChArc));
+    hierarchy.down_arcs = malloc((hierarchy.down_offsets[n] + 1) * sizeof(ChArc));
+    int shortcuts = 0;
+    for (int v = 0; v < n; v++) {
+        if (builder.out[v].count > 0) {
+            memcpy(hierarchy.up_arcs + hierarchy.up_offsets[v], builder.out[v].arcs,
+                   builder.out[v].count * sizeof(ChArc));
+        }
+        if (builder.in[v].count > 0) {
+            memcpy(hierarchy.down_arcs + hierarchy.down_offsets[v], builder.in[v].arcs,
+                   builder.in[v].count * sizeof(ChArc));
+        }
+        for (int i = 0; i < builder.out[v].count; i++) {
+            if (builder.out[v].arcs[i].middle != -1) shortcuts++;
+        }
+        for (int i = 0; i < builder.in[v].count; i++) {
+            if (builder.in[v].arcs[i].middle != -1) shortcuts++;
+        }
+    }
+
+    for (int v = 0; v < n; v++) {
+        free(builder.out[v].arcs);
+        free(builder.in[v].arcs);
+    }
+    free(builder.out);
+    free(builder.in);
+    free(builder.deleted_neighbors);
+    free(builder.witness_distance);
+    free(builder.touched);
+    heap_free(&builder.witness_heap);
+
+    hierarchy.forward_distance = malloc(size * sizeof(int));
+    hierarchy.backward_distance = malloc(size * sizeof(int));
+    hierarchy.forward_parent = malloc(size * sizeof(int));
+    hierarchy.backward_parent = malloc(size * sizeof(int));
+    hierarchy.touched = malloc(size * sizeof(int));
+    for (int v = 0; v < n; v++) {
+        hierarchy.forward_distance[v] = INT_MAX;
+        hierarchy.backward_distance[v] = INT_MAX;
+    }
+    heap_init(&hierarchy.forward_heap, n);
+    heap_init(&hierarchy.backward_heap, n);
+    hierarchy.touched_count = 0;
+    hierarchy.node_count = n;
+    hierarchy.shortcut_count = shortcuts;
+    hierarchy.valid = true;
+    fprintf(out, "Route hierarchy built: %d computers, %d shortcuts.\n", n, hierarchy.shortcut_count);
+}
+
+static int ch_arc_middle(int u, int x) {
+    if (hierarchy.rank[x] > hierarchy.rank[u]) {
+        for (int i = hierarchy.up_offsets[u]; i < hierarchy.up_offsets[u + 1]; i++) {
+            if (hierarchy.up_arcs[i].node == x) return hierarchy.up_arcs[i].middle;
+        }
+    } else {
+        for (int i = hierarchy.down_offsets[x]; i < hierarchy.down_offsets[x + 1]; i++) {
+            if (hierarchy.down_arcs[i].node == u) return hierarchy.down_arcs[i].middle;
+        }
+    }
+    return -1;
+}
+
+// Appends the real hops of arc u -> x (excluding u) to path
+static void ch_unpack(int u, int x, int* path, int* length) {
+    int middle = ch_arc_middle(u, x);
+    if (middle == -1) {
+        path[(*length)++] = x;
+        return;
+    }
+    ch_unpack(u, middle, path, length);
+    ch_unpack(middle, x, path, length);
+}
+
+static void ch_touch(int v) {
+    if (hierarchy.forward_distance[v] == INT_MAX && hierarchy.backward_distance[v] == INT_MAX) {
+        hierarchy.touched[hierarchy.touched_count++] = v;
+    }
+}
+
+// Upward bidirectional search on the hierarchy. Writes the unpacked hop
+// list start..end into path and returns the distance (INT_MAX if none).
+int hierarchy_search(int start, int end, int* path, int* length, int* settled) {
+    MetricMark mark = metrics_start();
+    for (int i = 0; i < hierarchy.touched_count; i++) {
+        int v = hierarchy.touched[i];
+        hierarchy.forward_distance[v] = INT_MAX;
+        hierarchy.backward_distance[v] = INT_MAX;
+    }
+    hierarchy.touched_count = 0;
+    heap_clear(&hierarchy.forward_heap);
+    heap_clear(&hierarchy.backward_heap);
+
+    ch_touch(start);
+    hierarchy.forward_distance[start] = 0;
+    hierarchy.forward_parent[start] = -1;
+    heap_push(&hierarchy.forward_heap, start, 0);
+    ch_touch(end);
+    hierarchy.backward_distance[end] = 0;
+    hierarchy.backward_parent[end] = -1;
+    heap_push(&hierarchy.backward_heap, end, 0);
+
+    int best = INT_MAX, meet = -1;
+    *settled = 0;
+    long long relaxed = 0;
+    while (1) {
+        bool forwardLive = hierarchy.forward_heap.size > 0 && hierarchy.forward_heap.keys[0] < best;
+        bool backwardLive = hierarchy.backward_heap.size > 0 && hierarchy.backward_heap.keys[0] < best;
+        if (!forwardLive && !backwardLive) break;
+
+        bool forward = forwardLive &&
+            (!backwardLive || hierarchy.forward_heap.keys[0] <= hierarchy.backward_heap.keys[0]);
+        MinHeap* heap = forward ? &hierarchy.forward_heap : &hierarchy.backward_heap;
+        int* dist = forward ? hierarchy.forward_distance : hierarchy.backward_distance;
+        int* other = forward ? hierarchy.backward_distance : hierarchy.forward_distance;
+        int* parent = forward ? hierarchy.forward_parent : hierarchy.backward_parent;
+        const int* offsets = forward ? hierarchy.up_offsets : hierarchy.down_offsets;
+        const ChArc* arcs = forward ? hierarchy.up_arcs : hierarchy.down_arcs;
+
+        int d;
+        int u = heap_pop(heap, &d);
+        (*settled)++;
+        if (other[u] != INT_MAX && (long long)d + other[u] < best) {
+            best = d + other[u];
+            meet = u;
+        }
+        relaxed += offsets[u + 1] - offsets[u];
+        for (int i = offsets[u]; i < offsets[u + 1]; i++) {
+            int v = arcs[i].node;
+            int candidate = d + arcs[i].weight;
+            if (candidate < dist[v]) {
+                ch_touch(v);
+                dist[v] = candidate;
+                parent[v] = u;
+                heap_push(heap, v, candidate);
+            }
+        }
+    }
+
+    metrics_work(*settled, relaxed, hierarchy.forward_heap.operations + hierarchy.backward_heap.operations);
+    metrics_finish(METRIC_HIERARCHY, mark);
+    *length = 0;
+    if (meet == -1) return INT_MAX;
+
+    // Forward half is collected backwards from the meeting point
+    int upCount = 0;
+    for (int v = meet; v != -1; v = hierarchy.forward_parent[v]) {
+        path[upCount++] = v;
+    }
+    for (int i = 0, j = upCount - 1; i < j; i++, j--) {
+        int swap = path[i];
+        path[i] = path[j];
+        path[j] = swap;
+    }
+    int* upper = malloc(upCount * sizeof(int));
+    memcpy(upper, path, upCount * sizeof(int));
+    *length = 1;
+    path[0] = start;
+    for (int i = 0; i + 1 < upCount; i++) {
+        ch_unpack(upper[i], upper[i + 1], path, length);
+    }
+    free(upper);
+    for (int v = meet; hierarchy.backward_parent[v] != -1; v = hierarchy.backward_parent[v]) {
+        ch_unpack(v, hierarchy.backward_parent[v], path, length);
+    }
+    return best;
+}
+
+void hierarchy_query(FILE* out, int start, int end) {
+    if (!is_valid_computer(start) || !is_valid_computer(end)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+    if (!hierarchy.valid) {
+        fprintf(out, "Route hierarchy is stale, rebuilding...\n");
+        build_hierarchy(out);
+        if (!hierarchy.valid) return;
+    }
+
+    int* path = malloc(nodes * sizeof(int));
+    int length, settled;
+    int distance = hierarchy_search(start, end, path, &length, &settled);
+    if (distance == INT_MAX) {
+        fprintf(out, "\nNo path from %d to %d found.\n", computer_handle(start), computer_handle(end));
+    } else {
+        fprintf(out, "\nShortest path from %d to %d: %dms\n", computer_handle(start), computer_handle(end), distance);
+        fprintf(out, "Path: ");
+        for (int i = length - 1; i >= 0; i--) {
+            fprintf(out, "%d <- ", computer_handle(path[i]));
+        }
+        fprintf(out, "END\n");
+    }
+    fprintf(out, "Computers settled: %d\n", settled);
+    free(path);
+}
+
+// Marks every computer reachable from source as affected. Computers that are
+// already affected are not expanded again, so repeated calls stay linear.
+// Returns how many were newly marked; they are left in queue[0 .. count).
+int mark_affected_from(int source, bool* affected, int* queue) {
+    if (affected[source]) return 0;
+    int front = 0, rear = 0;
+    queue[rear++] = source;
+    affected[source] = true;
+
+    while (front < rear) {
+        int node = queue[front++];
+        for (int e = graph.offsets[node]; e < graph.ends[node]; e++) {
+            int next = graph.destinations[e];
+            if (!affected[next]) {
+                affected[next] = true;
+                queue[rear++] = next;
+            }
+        }
+    }
+    return rear;
+}
+
+// Prints the negative cycle warning, with one offending cycle when known;
+// returns true when end is affected and no path can be reported.
+bool report_negative_cycle(FILE* out, const bool* affected, int end, const int* cycle, int cycleLength) {
+    fprintf(out, "\n⚠️  NEGATIVE WEIGHT CYCLE DETECTED!\n");
+    fprintf(out, "=====================================\n");
+    fprintf(out, "Shortest paths are UNDEFINED for affected nodes.\n");
+    fprintf(out, "Reason: You can loop infinitely to reduce path weight.\n");
+    if (cycleLength > 0) {
+        fprintf(out, "\nCycle: ");
+        for (int i = 0; i < cycleLength; i++) {
+            fprintf(out, "%d -> ", computer_handle(cycle[i]));
+        }
+        fprintf(out, "%d\n", computer_handle(cycle[0]));
+    }
+    fprintf(out, "\nAffected nodes: ");
+    for (int i = 0; i < nodes; i++) {
+        if (affected[i]) {
+            fprintf(out, "%d ", computer_handle(i));
+        }
+    }
+    fprintf(out, "\n\nRecommendation: Remove negative weight edges or restructure the network.\n");
+    fprintf(out, "=====================================\n");
+    
+    if (affected[end]) {
+        fprintf(out, "\nDestination node %d is affected by the negative cycle.\n", computer_handle(end));
+        fprintf(out, "Cannot compute shortest path - it would be -∞ (negative infinity).\n");
+        return true;
+    }
+    return false;
+}
+
+// Queue-based Bellman-Ford (SPFA) with Tarjan's subtree disassembly. The
+// shortest-path tree is kept as a preorder list with depths; when a
+// computer's distance drops, its old subtree is unlinked, and finding the
+// relaxing computer inside that subtree proves a negative cycle. Computers
+// reachable from a cycle are marked affected and skipped from then on, so
+// one pass reports every affected computer. Returns true if any cycle was
+// found; the first one is stored in cycle/cycleLength. With start = -1
+// every computer starts at distance 0, as if fed by a virtual source.
+bool spfa_search(int start, int* distance, int* previous, bool* affected, int* cycle, int* cycleLength) {
+    graph_compact();
+    MetricMark mark = metrics_start();
+    int* queue = malloc(nodes * sizeof(int));
+    int* scratch = malloc(nodes * sizeof(int));
+    int* treeNext = malloc(nodes * sizeof(int));
+    int* treePrev = malloc(nodes * sizeof(int));
+    int* depth = malloc(nodes * sizeof(int));
+    bool* inTree = calloc(nodes, sizeof(bool));
+    bool* inQueue = calloc(nodes, sizeof(bool));
+    for (int i = 0; i < nodes; i++) {
+        distance[i] = INT_MAX;
+        previous[i] = -1;
+        affected[i] = false;
+    }
+    *cycleLength = 0;
+
+    int head = 0, count = 0;
+    int first = start == -1 ? 0 : start;
+    int last = start == -1 ? nodes - 1 : start;
+    for (int v = first; v <= last; v++) {
+        distance[v] = 0;
+        inTree[v] = true;
+        depth[v] = 0;
+        treePrev[v] = v == first ? -1 : v - 1;
+        treeNext[v] = v == last ? -1 : v + 1;
+        queue[count++] = v;
+        inQueue[v] = true;
+    }
+    bool negCycle = false;
+    long long scanned = 0, relaxed = 0;
+
+    while (count > 0) {
+        int u = queue[head];
+        head = (head + 1) % nodes;
+        count--;
+        inQueue[u] = false;
+        if (!inTree[u] || affected[u]) continue;
+
+        scanned++;
+        relaxed += graph.ends[u] - graph.offsets[u];
+        for (int e = graph.offsets[u]; e < graph.ends[u] && !affected[u]; e++) {
+            int v = graph.destinations[e];
+            int candidate = distance[u] + graph.weights[e];
+            if (affected[v] || candidate >= distance[v]) continue;
+
+            if (inTree[v]) {
+                // Unlink v's subtree: the preorder run after v with greater depth
+                bool cycleFound = false;
+                int last = v;
+                for (int x = treeNext[v]; x != -1 && depth[x] > depth[v]; x = treeNext[x]) {
+                    if (x == u) cycleFound = true;
+                    inTree[x] = false;
+                    last = x;
+                }
+                if (treePrev[v] != -1) treeNext[treePrev[v]] = treeNext[last];
+                if (treeNext[last] != -1) treePrev[treeNext[last]] = treePrev[v];
+                inTree[v] = false;
+
+                if (cycleFound) {
+                    if (!negCycle) {
+                        int length = 0;
+                        for (int x = u; x != v; x = previous[x]) {
+                            scratch[length++] = x;
+                        }
+                        cycle[0] = v;
+                        for (int i = 0; i < length; i++) {
+                            cycle[i + 1] = scratch[length - 1 - i];
+                        }
+                        *cycleLength = length + 1;
+                    }
+                    negCycle = true;
+
+                    // Retire everything the cycle can reach from the tree
+                    int marked = mark_affected_from(v, affected, scratch);
+                    for (int i = 0; i < marked; i++) {
+                        int x = scratch[i];
+                        if (!inTree[x]) continue;
+                        if (treePrev[x] != -1) treeNext[treePrev[x]] = treeNext[x];
+                        if (treeNext[x] != -1) treePrev[treeNext[x]] = treePrev[x];
+                        inTree[x] = false;
+                    }
+                    continue;
+                }
+            }
+
+            distance[v] = candidate;
+            previous[v] = u;
+            inTree[v] = true;
+            depth[v] = depth[u] + 1;
+            treePrev[v] = u;
+            treeNext[v] = treeNext[u];
+            if (treeNext[u] != -1) treePrev[treeNext[u]] = v;
+            treeNext[u] = v;
+            if (!inQueue[v]) {
+                queue[(head + count) % nodes] = v;
+                count++;
+                inQueue[v] = true;
+            }
+        }
+    }
+
+    free(queue);
+    free(scratch);
+    free(treeNext);
+    free(treePrev);
+    free(depth);
+    free(inTree);
+    free(inQueue);
+    metrics_work(scanned, relaxed, 0);
+    metrics_finish(METRIC_BELLMAN_FORD, mark);
+    return negCycle;
+}
+
+#define PARALLEL_CHUNK 64
+
+// A computer's tentative distance and predecessor packed into one word, so a
+// relaxation can lower both with a single compare-and-swap. The distance is
+// stored with its sign bit flipped to make unsigned comparison order it.
+static inline uint64_t pack_state(int distance, int previous) {
+    return ((uint64_t)((uint32_t)distance ^ 0x80000000u) << 32) | (uint32_t)previous;
+}
+
+static inline int state_distance(uint64_t state) {
+    return (int)((uint32_t)(state >> 32) ^ 0x80000000u);
+}
+
+static inline int state_previous(uint64_t state) {
+    return (int)(uint32_t)state;
+}
+
+// Atomic min-update; returns true if candidate improved the distance.
+static bool relax_atomic(_Atomic uint64_t* slot, int candidate, int previous) {
+    uint64_t desired = pack_state(candidate, previous);
+    uint64_t current = atomic_load_explicit(slot, memory_order_relaxed);
+    while ((desired >> 32) < (current >> 32)) {
+        if (atomic_compare_exchange_weak_explicit(slot, &current, desired,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} IntList;
+
+static void int_list_push(IntList* list, int value) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity > 0 ? list->capacity * 2 : 64;
+        list->items = grow_array(list->items, list->capacity, sizeof(int));
+    }
+    list->items[list->count++] = value;
+}
+
+enum { PHASE_RELAX, PHASE_LIGHT, PHASE_HEAVY, PHASE_DONE };
+
+// Shared state of one parallel SSSP run. Workers pull chunks of the work
+// list through next_item and collect improved computers in their own
+// output list; worker 0 merges between barriers.
+typedef struct {
+    int thread_count;
+    pthread_barrier_t barrier;
+    _Atomic uint64_t* state;
+    atomic_char* queued;
+    IntList work;
+    IntList* output;
+    atomic_int next_item;
+    int phase;
+    int delta;
+    int round;
+    bool negative_cycle;
+    atomic_llong scanned;       // computers expanded, for the metrics
+    atomic_llong relaxed;
+    // Delta-stepping buckets, used cyclically
+    IntList* buckets;
+    int bucket_count;
+    int current_bucket;
+    int bucketed;
+    int* settled_mark;
+    IntList settled;
+} ParallelSssp;
+
+typedef struct {
+    ParallelSssp* run;
+    int id;
+} ParallelWorker;
+
+static void parallel_relax_work(ParallelSssp* run, IntList* output) {
+    long long scanned = 0, relaxed = 0;
+    while (1) {
+        int first = atomic_fetch_add_explicit(&run->next_item, PARALLEL_CHUNK, memory_order_relaxed);
+        if (first >= run->work.count) break;
+        int last = first + PARALLEL_CHUNK < run->work.count ? first + PARALLEL_CHUNK : run->work.count;
+        for (int i = first; i < last; i++) {
+            int u = run->work.items[i];
+            int du = state_distance(atomic_load_explicit(&run->state[u], memory_order_relaxed));
+            scanned++;
+            relaxed += graph.ends[u] - graph.offsets[u];
+            for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+                int w = graph.weights[e];
+                if (run->phase == PHASE_LIGHT && w > run->delta) continue;
+                if (run->phase == PHASE_HEAVY && w <= run->delta) continue;
+                int v = graph.destinations[e];
+                if (relax_atomic(&run->state[v], du + w, u)) {
+                    if (run->phase != PHASE_RELAX ||
+                        !atomic_exchange_explicit(&run->queued[v], 1, memory_order_relaxed)) {
+                        int_list_push(output, v);
+                    }
+                }
+            }
+        }
+    }
+    atomic_fetch_add_explicit(&run->scanned, scanned, memory_order_relaxed);
+    atomic_fetch_add_explicit(&run->relaxed, relaxed, memory_order_relaxed);
+}
+
+// Worker 0: turns the improved computers of the last round into the next
+// frontier and stops after nodes rounds, when a non-empty frontier means a
+// negative cycle.
+static void parallel_bellman_ford_step(ParallelSssp* run) {
+    run->work.count = 0;
+    for (int t = 0; t < run->thread_count; t++) {
+        for (int i = 0; i < run->output[t].count; i++) {
+            int v = run->output[t].items[i];
+            atomic_store_explicit(&run->queued[v], 0, memory_order_relaxed);
+            int_list_push(&run->work, v);
+        }
+        run->output[t].count = 0;
+    }
+    run->round++;
+    if (run->work.count == 0) {
+        run->phase = PHASE_DONE;
+    } else if (run->round >= nodes) {
+        run->negative_cycle = true;
+        run->phase = PHASE_DONE;
+    }
+    atomic_store_explicit(&run->next_item, 0, memory_order_relaxed);
+}
+
+static int bucket_of(ParallelSssp* run, int v) {
+    return state_distance(atomic_load_explicit(&run->state[v], memory_order_relaxed)) / run->delta;
+}
+
+static void bucket_insert(ParallelSssp* run, int v) {
+    int_list_push(&run->buckets[bucket_of(run, v) % run->bucket_count], v);
+    run->bucketed++;
+}
+
+// Worker 0: files improved computers into buckets, then picks the next
+// light phase from the current bucket or closes it with a heavy phase.
+static void delta_stepping_step(ParallelSssp* run) {
+    for (int t = 0; t < run->thread_count; t++) {
+        for (int i = 0; i < run->output[t].count; i++) {
+            bucket_insert(run, run->output[t].items[i]);
+        }
+        run->output[t].count = 0;
+    }
+    atomic_store_explicit(&run->next_item, 0, memory_order_relaxed);
+    run->work.count = 0;
+
+    while (run->bucketed > 0 || run->phase == PHASE_LIGHT) {
+        IntList* bucket = &run->buckets[run->current_bucket % run->bucket_count];
+        if (bucket->count > 0) {
+            // Drop entries whose distance has since moved to an earlier bucket
+            for (int i = 0; i < bucket->count; i++) {
+                int v = bucket->items[i];
+                if (bucket_of(run, v) != run->current_bucket) continue;
+                if (run->settled_mark[v] != run->current_bucket) {
+                    run->settled_mark[v] = run->current_bucket;
+                    int_list_push(&run->settled, v);
+                }
+                int_list_push(&run->work, v);
+            }
+            run->bucketed -= bucket->count;
+            bucket->count = 0;
+            if (run->work.count > 0) {
+                run->phase = PHASE_LIGHT;
+                return;
+            }
+            continue;
+        }
+        if (run->settled.count > 0) {
+            IntList swap = run->work;
+            run->work = run->settled;
+            run->settled = swap;
+            run->settled.count = 0;
+            run->phase = PHASE_HEAVY;
+            run->current_bucket++;
+            return;
+        }
+        run->phase = PHASE_RELAX;
+        run->current_bucket++;
+    }
+    run->phase = PHASE_DONE;
+}
+
+static void* parallel_sssp_worker(void* arg) {
+    ParallelWorker* worker = arg;
+    ParallelSssp* run = worker->run;
+    bool deltaStepping = run->buckets != NULL;
+    while (1) {
+        pthread_barrier_wait(&run->barrier);
+        if (run->phase == PHASE_DONE) break;
+        parallel_relax_work(run, &run->output[worker->id]);
+        pthread_barrier_wait(&run->barrier);
+        if (worker->id == 0) {
+            if (deltaStepping) {
+                delta_stepping_step(run);
+            } else {
+                parallel_bellman_ford_step(run);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Runs the parallel engine from start with worker_threads workers. With
+// delta > 0 it uses delta-stepping (non-negative weights only); otherwise a
+// frontier-based Bellman-Ford that flags negative cycles. Returns true if a
+// negative cycle was found, in which case affected is filled in.
+bool parallel_sssp(int start, int delta, int* distance, int* previous, bool* affected) {
+    graph_compact();
+    MetricMark mark = metrics_start();
+    ParallelSssp run;
+    memset(&run, 0, sizeof(run));
+    run.thread_count = worker_threads > 0 ? worker_threads : 1;
+    run.state = malloc(nodes * sizeof(*run.state));
+    run.queued = calloc(nodes, sizeof(*run.queued));
+    run.output = calloc(run.thread_count, sizeof(IntList));
+    run.delta = delta;
+    for (int i = 0; i < nodes; i++) {
+        atomic_init(&run.state[i], pack_state(INT_MAX, -1));
+    }
+    atomic_init(&run.state[start], pack_state(0, -1));
+    atomic_init(&run.next_item, 0);
+
+    if (delta > 0) {
+        int maxWeight = 0;
+        for (int u = 0; u < nodes; u++) {
+            for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+                if (graph.weights[e] > maxWeight) maxWeight = graph.weights[e];
+            }
+        }
+        run.bucket_count = maxWeight / delta + 2;
+        run.buckets = calloc(run.bucket_count, sizeof(IntList));
+        run.settled_mark = malloc(nodes * sizeof(int));
+        for (int i = 0; i < nodes; i++) {
+            run.settled_mark[i] = -1;
+        }
+        run.phase = PHASE_RELAX;
+        bucket_insert(&run, start);
+        delta_stepping_step(&run);
+    } else {
+        int_list_push(&run.work, start);
+        run.phase = PHASE_RELAX;
+    }
+
+    pthread_barrier_init(&run.barrier, NULL, run.thread_count);
+    pthread_t* threads = malloc(run.thread_count * sizeof(pthread_t));
+    ParallelWorker* workers = malloc(run.thread_count * sizeof(ParallelWorker));
+    for (int t = 0; t < run.thread_count; t++) {
+        workers[t].run = &run;
+        workers[t].id = t;
+        if (t > 0) pthread_create(&threads[t], NULL, parallel_sssp_worker, &workers[t]);
+    }
+    parallel_sssp_worker(&workers[0]);
+    for (int t = 1; t < run.thread_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_barrier_destroy(&run.barrier);
+    metrics_work(run.scanned, run.relaxed, 0);
+    metrics_finish(delta > 0 ? METRIC_DELTA_STEPPING : METRIC_PARALLEL_BELLMAN_FORD, mark);
+
+    for (int i = 0; i < nodes; i++) {
+        uint64_t state = atomic_load_explicit(&run.state[i], memory_order_relaxed);
+        distance[i] = state_distance(state);
+        previous[i] = state_previous(state);
+    }
+    if (run.negative_cycle) {
+        int* queue = malloc(nodes * sizeof(int));
+        for (int i = 0; i < nodes; i++) {
+            affected[i] = false;
+        }
+        for (int i = 0; i < run.work.count; i++) {
+            mark_affected_from(run.work.items[i], affected, queue);
+        }
+        free(queue);
+    }
+
+    for (int t = 0; t < run.thread_count; t++) {
+        free(run.output[t].items);
+    }
+    for (int b = 0; b < run.bucket_count; b++) {
+        free(run.buckets[b].items);
+    }
+    free(run.buckets);
+    free(run.settled_mark);
+    free(run.settled.items);
+    free(run.work.items);
+    free(run.output);
+    free(run.queued);
+    free(run.state);
+    free(threads);
+    free(workers);
+    return run.negative_cycle;
+}
+
+// Bucket width for delta-stepping: the mean route latency keeps light
+// phases short.
+int delta_stepping_width() {
+    graph_compact();
+    long long total = 0, count = 0;
+    for (int u = 0; u < nodes; u++) {
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            total += graph.weights[e];
+            count++;
+        }
+    }
+    return count > 0 && total / count > 0 ? (int)(total / count) : 1;
+}
+
+void parallel_shortest_path(FILE* out, int start, int end, bool deltaStepping) {
+    if (!is_valid_computer(start) || !is_valid_computer(end)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+    if (deltaStepping && has_negative_weights()) {
+        fprintf(out, "\n⚠️  ALGORITHM ERROR\n");
+        fprintf(out, "=====================================\n");
+        fprintf(out, "Delta-stepping cannot be used with negative edge weights.\n");
+        fprintf(out, "Please use Parallel Bellman-Ford instead.\n");
+        fprintf(out, "=====================================\n");
+        return;
+    }
+
+    int delta = deltaStepping ? delta_stepping_width() : 0;
+
+    int* distance = malloc(nodes * sizeof(int));
+    int* previous = malloc(nodes * sizeof(int));
+    bool* affected = malloc(nodes * sizeof(bool));
+    bool negCycle = parallel_sssp(start, delta, distance, previous, affected);
+    if (!negCycle || !report_negative_cycle(out, affected, end, NULL, 0)) {
+        print_path(out, start, end, distance, previous);
+    }
+    fprintf(out, "Worker threads: %d\n", worker_threads);
+    free(distance);
+    free(previous);
+    free(affected);
+}
+
+// Computes Johnson potentials once per topology version. Returns false if
+// the graph has a negative cycle, in which case no reweighting exists.
+bool ensure_potentials() {
+    if (potentials_valid) return !potentials_cycle;
+    graph_compact();
+
+    release_array(potentials);
+    release_array(reweighted);
+    potentials = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    int* previous = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    bool* affected = malloc((nodes > 0 ? nodes : 1) * sizeof(bool));
+    int* cycle = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    int cycleLength;
+    potentials_cycle = nodes > 0 && spfa_search(-1, potentials, previous, affected, cycle, &cycleLength);
+    free(previous);
+    free(affected);
+    free(cycle);
+
+    int edges = 0;
+    for (int u = 0; u < nodes; u++) {
+        if (graph.ends[u] > edges) edges = graph.ends[u];
+    }
+    reweighted = malloc((edges > 0 ? edges : 1) * sizeof(int));
+    if (!potentials_cycle) {
+        for (int u = 0; u < nodes; u++) {
+            for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+                reweighted[e] = graph.weights[e] + potentials[u] - potentials[graph.destinations[e]];
+            }
+        }
+    }
+    potentials_valid = true;
+    return !potentials_cycle;
+}
+
+// Dijkstra on the reweighted latencies, converted back to true distances.
+// Fills distance/previous like dijkstra_search(); returns settled count.
+int johnson_search(int start, int target, int* distance, int* previous) {
+    MetricMark mark = metrics_start();
+    int settled = heap_search(nodes, graph.offsets, graph.ends, graph.destinations, reweighted,
+                              start, target, distance, previous);
+    metrics_finish(METRIC_JOHNSON, mark);
+    for (int v = 0; v < nodes; v++) {
+        if (distance[v] != INT_MAX) {
+            distance[v] = distance[v] - potentials[start] + potentials[v];
+        }
+    }
+    return settled;
+}
+
+// Immutable copy of the network that queries can run on while the live
+// graph keeps changing. Rows are stored densely: the routes leaving u are
+// destinations/weights[offsets[u] .. offsets[u + 1]).
+typedef struct GraphView {
+    unsigned long version;      // graph_version it was copied at
+    int nodes;
+    int* state;                 // computers.state: liveness and generation
+    int* offsets;
+    int* destinations;
+    int* weights;
+    int* reweighted;            // Johnson weights, with negative routes only
+    int* potentials;
+    bool cycle;                 // negative routes form a cycle: no distances
+    unsigned long long retired; // epoch at which it was replaced
+    struct GraphView* next_retired;
+} GraphView;
+
+// A reader thread's announcement: the epoch it pinned a view in, or 0.
+typedef struct EpochRecord {
+    atomic_ullong epoch;
+    struct EpochRecord* next;
+    struct EpochRecord* next_free;
+} EpochRecord;
+
+// Publication of graph views with epoch-based reclamation. Readers pin the
+// current view without locks by announcing the global epoch before loading
+// it. A publish swaps in the new view, retires the old one under the epoch
+// and advances the epoch; a retired view is freed once every announced
+// epoch is later than its own, since no reader can still hold it then.
+// Publishing is for the thread that changes the network.
+typedef struct {
+    _Atomic(GraphView*) current;
+    atomic_ullong epoch;
+    pthread_mutex_t lock;       // record list and reclamation
+    pthread_once_t once;
+    pthread_key_t key;
+    EpochRecord* records;
+    EpochRecord* free_records;  // records of exited threads
+    GraphView* retired;
+    int retired_count;
+    long long published;
+    long long reclaimed;
+} ViewDomain;
+
+ViewDomain views = {
+    .epoch = 1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT
+};
+_Thread_local EpochRecord* thread_epoch = NULL;
+
+static void view_release_record(void* record) {
+    EpochRecord* released = record;
+    atomic_store(&released->epoch, 0);
+    pthread_mutex_lock(&views.lock);
+    released->next_free = views.free_records;
+    views.free_records = released;
+    pthread_mutex_unlock(&views.lock);
+}
+
+static void view_create_key() {
+    pthread_key_create(&views.key, view_release_record);
+}
+
+static EpochRecord* view_record() {
+    if (thread_epoch) return thread_epoch;
+    pthread_once(&views.once, view_create_key);
+    pthread_mutex_lock(&views.lock);
+    EpochRecord* record = views.free_records;
+    if (record) {
+        views.free_records = record->next_free;
+    } else {
+        record = calloc(1, sizeof(EpochRecord));
+        if (!record) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        record->next = views.records;
+        views.records = record;
+    }
+    pthread_mutex_unlock(&views.lock);
+    pthread_setspecific(views.key, record);
+    thread_epoch = record;
+    return record;
+}
+
+// Returns the current view, or NULL if none was published. It stays valid
+// until view_unpin(); a thread holds one pin at a time.
+const GraphView* view_pin() {
+    EpochRecord* record = view_record();
+    // Announced before the load, so a publish that retires this view sees it
+    atomic_store(&record->epoch, atomic_load(&views.epoch));
+    return atomic_load(&views.current);
+}
+
+void view_unpin() {
+    atomic_store_explicit(&thread_epoch->epoch, 0, memory_order_release);
+}
+
+static void view_free(GraphView* view) {
+    free(view->state);
+    free(view->offsets);
+    free(view->destinations);
+    free(view->weights);
+    free(view->reweighted);
+    free(view->potentials);
+    free(view);
+}
+
+// Frees the retired views older than every pinned epoch.
+static void view_reclaim() {
+    pthread_mutex_lock(&views.lock);
+    unsigned long long oldest = ULLONG_MAX;
+    for (EpochRecord* record = views.records; record; record = record->next) {
+        unsigned long long epoch = atomic_load(&record->epoch);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    GraphView** link = &views.retired;
+    while (*link) {
+        GraphView* view = *link;
+        if (view->retired < oldest) {
+            *link = view->next_retired;
+            view_free(view);
+            views.retired_count--;
+            views.reclaimed++;
+        } else {
+            link = &view->next_retired;
+        }
+    }
+    pthread_mutex_unlock(&views.lock);
+}
+
+// Publishes a view of the network as it is now, unless the current one is
+// up to date, and reclaims the views no reader holds any more.
+void view_publish() {
+    GraphView* current = atomic_load(&views.current);
+    if (current && current->version == graph_version) return;
+    graph_compact();
+    bool negative = has_negative_weights();
+    bool cycle = negative && !ensure_potentials();
+
+    int edges = 0;
+    for (int u = 0; u < nodes; u++) edges += graph.ends[u] - graph.offsets[u];
+    GraphView* view = calloc(1, sizeof(GraphView));
+    if (!view) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    view->version = graph_version;
+    view->nodes = nodes;
+    view->cycle = cycle;
+    view->state = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    view->offsets = malloc((nodes + 1) * sizeof(int));
+    view->destinations = malloc((edges > 0 ? edges : 1) * sizeof(int));
+    view->weights = malloc((edges > 0 ? edges : 1) * sizeof(int));
+    if (negative && !cycle) {
+        view->reweighted = malloc((edges > 0 ? edges : 1) * sizeof(int));
+        view->potentials = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    }
+    if (!view->state || !view->offsets || !view->destinations || !view->weights ||
+        (negative && !cycle && (!view->reweighted || !view->potentials))) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    if (nodes > 0) memcpy(view->state, computers.state, nodes * sizeof(int));
+    if (view->potentials && nodes > 0) memcpy(view->potentials, potentials, nodes * sizeof(int));
+    int e = 0;
+    for (int u = 0; u < nodes; u++) {
+        view->offsets[u] = e;
+        int count = graph.ends[u] - graph.offsets[u];
+        if (count == 0) continue;
+        memcpy(view->destinations + e, graph.destinations + graph.offsets[u], count * sizeof(int));
+        memcpy(view->weights + e, graph.weights + graph.offsets[u], count * sizeof(int));
+        if (view->reweighted) memcpy(view->reweighted + e, reweighted + graph.offsets[u], count * sizeof(int));
+        e += count;
+    }
+    view->offsets[nodes] = e;
+
+    GraphView* old = atomic_exchange(&views.current, view);
+    views.published++;
+    if (old) {
+        old->retired = atomic_fetch_add(&views.epoch, 1);
+        pthread_mutex_lock(&views.lock);
+        old->next_retired = views.retired;
+        views.retired = old;
+        views.retired_count++;
+        pthread_mutex_unlock(&views.lock);
+    }
+    view_reclaim();
+}
+
+// The handle of slot in view.
+int view_handle(const GraphView* view, int slot) {
+    return slot | ((view->state[slot] >> 1) % HANDLE_GENERATIONS) << HANDLE_SLOT_BITS;
+}
+
+// resolve_computer() against view, reporting stale handles to out.
+int view_resolve(const GraphView* view, int handle, FILE* out) {
+    if (handle < 0) return -1;
+    int slot = handle & HANDLE_SLOT_MASK;
+    if (slot >= view->nodes) return -1;
+    if (!(view->state[slot] & 1) || view_handle(view, slot) != handle) {
+        fprintf(out, "Computer handle %d is stale.\n", handle);
+        return -1;
+    }
+    return slot;
+}
+
+// Dijkstra, or Johnson with negative routes, on view; distance and previous
+// need view->nodes entries. The caller checks view->cycle first.
+int view_search(const GraphView* view, int start, int target, int* distance, int* previous) {
+    MetricMark mark = metrics_start();
+    int settled = heap_search(view->nodes, view->offsets, view->offsets + 1, view->destinations,
+                              view->reweighted ? view->reweighted : view->weights,
+                              start, target, distance, previous);
+    if (!view->reweighted) {
+        metrics_finish(METRIC_DIJKSTRA, mark);
+        return settled;
+    }
+    metrics_finish(METRIC_JOHNSON, mark);
+    for (int v = 0; v < view->nodes; v++) {
+        if (distance[v] != INT_MAX) {
+            distance[v] = distance[v] - view->potentials[start] + view->potentials[v];
+        }
+    }
+    return settled;
+}
+
+// Min-plus update of tile C from tiles A and B: for every k in the tile,
+// C[i][j] = min(C[i][j], A[i][k] + B[k][j]) with predecessors taken from B.
+static void apsp_tile_scalar(int* c, int* pc, const int* a, const int* b, const int* pb, int stride) {
+    for (int k = 0; k < APSP_TILE; k++) {
+        const int* bRow = b + k * stride;
+        const int* pbRow = pb + k * stride;
+        for (int i = 0; i < APSP_TILE; i++) {
+            int aik = a[i * stride + k];
+            if (aik >= APSP_INF / 2) continue;
+            int* cRow = c + i * stride;
+            int* pcRow = pc + i * stride;
+            for (int j = 0; j < APSP_TILE; j++) {
+                int sum = aik + bRow[j];
+                if (sum < cRow[j]) {
+                    cRow[j] = sum;
+                    pcRow[j] = pbRow[j];
+                }
+            }
+        }
+    }
+}
+
+#ifdef APSP_SIMD
+__attribute__((target("avx2")))
+static void apsp_tile_avx2(int* c, int* pc, const int* a, const int* b, const int* pb, int stride) {
+    for (int k = 0; k < APSP_TILE; k++) {
+        const int* bRow = b + k * stride;
+        const int* pbRow = pb + k * stride;
+        for (int i = 0; i < APSP_TILE; i++) {
+            int aik = a[i * stride + k];
+            if (aik >= APSP_INF / 2) continue;
+            __m256i vaik = _mm256_set1_epi32(aik);
+            int* cRow = c + i * stride;
+            int* pcRow = pc + i * stride;
+            for (int j = 0; j < APSP_TILE; j += 8) {
+                __m256i sum = _mm256_add_epi32(vaik, _mm256_loadu_si256((const __m256i*)(bRow + j)));
+                __m256i current = _mm256_loadu_si256((const __m256i*)(cRow + j));
+                __m256i better = _mm256_cmpgt_epi32(current, sum);
+                __m256i pred = _mm256_blendv_epi8(_mm256_loadu_si256((const __m256i*)(pcRow + j)),
+                                                  _mm256_loadu_si256((const __m256i*)(pbRow + j)), better);
+                _mm256_storeu_si256((__m256i*)(cRow + j), _mm256_min_epi32(current, sum));
+                _mm256_storeu_si256((__m256i*)(pcRow + j), pred);
+            }
+        }
+    }
+}
+
+__attribute__((target("sse4.1")))
+static void apsp_tile_sse(int* c, int* pc, const int* a, const int* b, const int* pb, int stride) {
+    for (int k = 0; k < APSP_TILE; k++) {
+        const int* bRow = b + k * stride;
+        const int* pbRow = pb + k * stride;
+        for (int i = 0; i < APSP_TILE; i++) {
+            int aik = a[i * stride + k];
+            if (aik >= APSP_INF / 2) continue;
+            __m128i vaik = _mm_set1_epi32(aik);
+            int* cRow = c + i * stride;
+            int* pcRow = pc + i * stride;
+            for (int j = 0; j < APSP_TILE; j += 4) {
+                __m128i sum = _mm_add_epi32(vaik, _mm_loadu_si128((const __m128i*)(bRow + j)));
+                __m128i current = _mm_loadu_si128((const __m128i*)(cRow + j));
+                __m128i better = _mm_cmpgt_epi32(current, sum);
+                __m128i pred = _mm_blendv_epi8(_mm_loadu_si128((const __m128i*)(pcRow + j)),
+                                               _mm_loadu_si128((const __m128i*)(pbRow + j)), better);
+                _mm_storeu_si128((__m128i*)(cRow + j), _mm_min_epi32(current, sum));
+                _mm_storeu_si128((__m128i*)(pcRow + j), pred);
+            }
+        }
+    }
+}
+#endif
+
+typedef void (*ApspKernel)(int*, int*, const int*, const int*, const int*, int);
+
+static ApspKernel apsp_select_kernel(const char** name) {
+#ifdef APSP_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "AVX2";
+        return apsp_tile_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        *name = "SSE4.1";
+        return apsp_tile_sse;
+    }
+#endif
+    *name = "scalar";
+    return apsp_tile_scalar;
+}
+
+typedef struct {
+    pthread_barrier_t barrier;
+    ApspKernel kernel;
+    int thread_count;
+    int blocks;
+} ApspRun;
+
+typedef struct {
+    ApspRun* run;
+    int id;
+} ApspWorker;
+
+static void apsp_update(ApspRun* run, int ci, int cj, int ai, int aj, int bi, int bj) {
+    int size = apsp.size;
+    int* d = apsp.distance;
+    int* p = apsp.previous;
+    size_t c = (size_t)ci * APSP_TILE * size + cj * APSP_TILE;
+    size_t a = (size_t)ai * APSP_TILE * size + aj * APSP_TILE;
+    size_t b = (size_t)bi * APSP_TILE * size + bj * APSP_TILE;
+    run->kernel(d + c, p + c, d + a, d + b, p + b, size);
+}
+
+// Blocked Floyd-Warshall: per diagonal block kb, worker 0 closes the
+// diagonal tile, then all workers share the tiles in row and column kb,
+// then the remaining tiles, with a barrier between phases.
+static void* apsp_worker(void* arg) {
+    ApspWorker* worker = arg;
+    ApspRun* run = worker->run;
+    int blocks = run->blocks;
+    for (int kb = 0; kb < blocks; kb++) {
+        if (worker->id == 0) apsp_update(run, kb, kb, kb, kb, kb, kb);
+        pthread_barrier_wait(&run->barrier);
+
+        for (int t = worker->id; t < 2 * blocks; t += run->thread_count) {
+            int other = t / 2;
+            if (other == kb) continue;
+            if (t % 2 == 0) {
+                apsp_update(run, kb, other, kb, kb, kb, other);
+            } else {
+                apsp_update(run, other, kb, other, kb, kb, kb);
+            }
+        }
+        pthread_barrier_wait(&run->barrier);
+
+        for (int t = worker->id; t < blocks * blocks; t += run->thread_count) {
+            int bi = t / blocks, bj = t % blocks;
+            if (bi == kb || bj == kb) continue;
+            apsp_update(run, bi, bj, bi, kb, kb, bj);
+        }
+        pthread_barrier_wait(&run->barrier);
+    }
+    return NULL;
+}
+
+void free_apsp() {
+    free(apsp.distance);
+    free(apsp.previous);
+    memset(&apsp, 0, sizeof(apsp));
+}
+
+// Builds the all-pairs matrices from the current routes. Refuses on a
+// negative cycle, where Floyd-Warshall distances are meaningless.
+bool build_apsp(FILE* out) {
+    if (apsp.valid) return true;
+    if (has_negative_weights() && !ensure_potentials()) {
+        fprintf(out, "Negative weight cycle detected: all-pairs latencies are undefined.\n");
+        fprintf(out, "Please use Bellman-Ford to see the affected nodes.\n");
+        return false;
+    }
+    graph_compact();
+    free_apsp();
+
+    int blocks = (nodes + APSP_TILE - 1) / APSP_TILE;
+    int size = blocks * APSP_TILE + APSP_ROW_PAD;
+    size_t cells = (size_t)size * size;
+    apsp.distance = malloc(cells * sizeof(int) + 1);
+    apsp.previous = malloc(cells * sizeof(int) + 1);
+    if (!apsp.distance || !apsp.previous) {
+        fprintf(out, "Not enough memory for a %d x %d latency matrix.\n", nodes, nodes);
+        free_apsp();
+        return false;
+    }
+    apsp.size = size;
+    apsp.node_count = nodes;
+    for (size_t i = 0; i < cells; i++) {
+        apsp.distance[i] = APSP_INF;
+        apsp.previous[i] = -1;
+    }
+    for (int u = 0; u < nodes; u++) {
+        apsp.distance[(size_t)u * size + u] = 0;
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            size_t cell = (size_t)u * size + graph.destinations[e];
+            if (graph.weights[e] < apsp.distance[cell]) {
+                apsp.distance[cell] = graph.weights[e];
+                apsp.previous[cell] = u;
+            }
+        }
+    }
+
+    const char* kernelName;
+    ApspRun run;
+    run.kernel = apsp_select_kernel(&kernelName);
+    run.blocks = blocks;
+    run.thread_count = worker_threads > 0 ? worker_threads : 1;
+    pthread_barrier_init(&run.barrier, NULL, run.thread_count);
+    pthread_t* threads = malloc(run.thread_count * sizeof(pthread_t));
+    ApspWorker* workers = malloc(run.thread_count * sizeof(ApspWorker));
+    for (int t = 0; t < run.thread_count; t++) {
+        workers[t].run = &run;
+        workers[t].id = t;
+        if (t > 0) pthread_create(&threads[t], NULL, apsp_worker, &workers[t]);
+    }
+    apsp_worker(&workers[0]);
+    for (int t = 1; t < run.thread_count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_barrier_destroy(&run.barrier);
+    free(threads);
+    free(workers);
+
+    apsp.valid = true;
+    fprintf(out, "All-pairs matrix built: %d computers, %s kernel, %d threads.\n",
+            nodes, kernelName, run.thread_count);
+    return true;
+}
+
+static int apsp_distance(int from, int to) {
+    int d = apsp.distance[(size_t)from * apsp.size + to];
+    return d >= APSP_INF / 2 ? INT_MAX : d;
+}
+
+void apsp_query(FILE* out, int start, int end) {
+    if (!is_valid_computer(start) || !is_valid_computer(end)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+    if (!build_apsp(out)) return;
+
+    // The matrix row of start is a ready-made predecessor array
+    int* distance = malloc(nodes * sizeof(int));
+    for (int v = 0; v < nodes; v++) {
+        distance[v] = apsp_distance(start, v);
+    }
+    print_path(out, start, end, distance, apsp.previous + (size_t)start * apsp.size);
+    free(distance);
+}
+
+void display_latency_matrix(FILE* out) {
+    if (!build_apsp(out)) return;
+    if (nodes > 20) {
+        fprintf(out, "Matrix has %d x %d entries; use the export option to save it.\n", nodes, nodes);
+        return;
+    }
+    fprintf(out, "\nLatency matrix (ms, - = unreachable):\n      ");
+    for (int j = 0; j < nodes; j++) {
+        if (is_valid_computer(j)) fprintf(out, "%6d", computer_handle(j));
+    }
+    fprintf(out, "\n");
+    for (int i = 0; i < nodes; i++) {
+        if (!is_valid_computer(i)) continue;
+        fprintf(out, "%6d", computer_handle(i));
+        for (int j = 0; j < nodes; j++) {
+            if (!is_valid_computer(j)) continue;
+            int d = apsp_distance(i, j);
+            if (d == INT_MAX) {
+                fprintf(out, "%6s", "-");
+            } else {
+                fprintf(out, "%6d", d);
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
+
+// Binary layout: "DSCPAPSP", uint32 version (1), uint32 computer count n,
+// then n*n int32 distances (INT_MAX = unreachable) and n*n int32
+// predecessors (-1 = none), both row-major, in host byte order.
+void export_latency_matrix(FILE* out, const char* filename) {
+    if (!build_apsp(out)) return;
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(out, "Error: Could not open %s for writing.\n", filename);
+        return;
+    }
+
+    uint32_t header[2] = {1, (uint32_t)nodes};
+    fwrite("DSCPAPSP", 1, 8, file);
+    fwrite(header, sizeof(uint32_t), 2, file);
+    int* row = malloc((nodes > 0 ? nodes : 1) * sizeof(int));
+    for (int i = 0; i < nodes; i++) {
+        for (int j = 0; j < nodes; j++) {
+            row[j] = apsp_distance(i, j);
+        }
+        fwrite(row, sizeof(int), nodes, file);
+    }
+    for (int i = 0; i < nodes; i++) {
+        fwrite(apsp.previous + (size_t)i * apsp.size, sizeof(int), nodes, file);
+    }
+    free(row);
+
+    if (fclose(file) == 0) {
+        fprintf(out, "Latency matrix exported to %s.\n", filename);
+    } else {
+        fprintf(out, "Error: Could not write %s.\n", filename);
+    }
+}
+
+// Menu numbers of the algorithms whose trees the path cache keeps.
+enum {
+    ALG_DIJKSTRA = 1,
+    ALG_BELLMAN_FORD = 2,
+    ALG_JOHNSON = 8
+};
+
+static unsigned path_cache_slot(int source, int algorithm) {
+    uint32_t hash = (uint32_t)source * 2654435761u ^ (uint32_t)algorithm * 40503u;
+    return hash & (path_cache.bucket_count - 1);
+}
+
+static void path_cache_unlink(PathTree* tree) {
+    if (tree->newer) tree->newer->older = tree->older;
+    else path_cache.newest = tree->older;
+    if (tree->older) tree->older->newer = tree->newer;
+    else path_cache.oldest = tree->newer;
+}
+
+static void path_cache_push_front(PathTree* tree) {
+    tree->newer = NULL;
+    tree->older = path_cache.newest;
+    if (path_cache.newest) path_cache.newest->newer = tree;
+    else path_cache.oldest = tree;
+    path_cache.newest = tree;
+}
+
+static void path_cache_remove(PathTree* tree) {
+    PathTree** link = &path_cache.buckets[path_cache_slot(tree->source, tree->algorithm)];
+    while (*link != tree) link = &(*link)->next;
+    *link = tree->next;
+    path_cache_unlink(tree);
+    path_cache.count--;
+    path_cache.bytes -= tree->bytes;
+    free(tree->distance);
+    free(tree->previous);
+    free(tree->affected);
+    free(tree->cycle);
+    free(tree);
+}
+
+static void path_cache_grow() {
+    int oldCount = path_cache.bucket_count;
+    PathTree** oldBuckets = path_cache.buckets;
+    path_cache.bucket_count = oldCount > 0 ? oldCount * 2 : 64;
+    path_cache.buckets = calloc(path_cache.bucket_count, sizeof(PathTree*));
+    if (!path_cache.buckets) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    for (int i = 0; i < oldCount; i++) {
+        PathTree* tree = oldBuckets[i];
+        while (tree) {
+            PathTree* next = tree->next;
+            unsigned slot = path_cache_slot(tree->source, tree->algorithm);
+            tree->next = path_cache.buckets[slot];
+            path_cache.buckets[slot] = tree;
+            tree = next;
+        }
+    }
+    free(oldBuckets);
+}
+
+void path_cache_flush() {
+    while (path_cache.oldest) {
+        path_cache_remove(path_cache.oldest);
+    }
+}
+
+// Finds a cached tree and marks it most recently used. Trees built before
+// the last topology change are dropped here rather than in graph_changed().
+static PathTree* path_cache_lookup(int source, int algorithm) {
+    if (path_cache.version != graph_version) {
+        path_cache_flush();
+        path_cache.version = graph_version;
+    }
+    if (path_cache.count == 0) return NULL;
+
+    PathTree* tree = path_cache.buckets[path_cache_slot(source, algorithm)];
+    while (tree && (tree->source != source || tree->algorithm != algorithm)) {
+        tree = tree->next;
+    }
+    if (tree) {
+        path_cache_unlink(tree);
+        path_cache_push_front(tree);
+    }
+    return tree;
+}
+
+// Adds a tree, then evicts least recently used trees until the cache fits
+// its budget again. The new tree itself is never evicted.
+static void path_cache_insert(PathTree* tree) {
+    if (path_cache.count >= path_cache.bucket_count) path_cache_grow();
+    unsigned slot = path_cache_slot(tree->source, tree->algorithm);
+    tree->next = path_cache.buckets[slot];
+    path_cache.buckets[slot] = tree;
+    path_cache_push_front(tree);
+    path_cache.count++;
+    path_cache.bytes += tree->bytes;
+
+    while (path_cache.bytes > path_cache.budget && path_cache.oldest != tree) {
+        path_cache_remove(path_cache.oldest);
+        path_cache.evictions++;
+    }
+}
+
+// True if the tree already holds the final distance to target.
+static bool path_tree_covers(const PathTree* tree, int target) {
+    if (tree->radius == INT_MAX) return true;
+    int d = tree->distance[target];
+    if (d == INT_MAX) return false;
+    if (tree->algorithm == ALG_JOHNSON) {
+        d += potentials[tree->source] - potentials[target];
+    }
+    return d <= tree->radius;
+}
+
+// Returns the shortest-path tree from source, searching only on a miss.
+// The tree belongs to the cache and stays valid until the next cache call.
+// Johnson callers must have ensure_potentials() succeed first.
+PathTree* shortest_path_tree(int source, int target, int algorithm) {
+    PathTree* tree = path_cache_lookup(source, algorithm);
+    if (tree && path_tree_covers(tree, target)) {
+        path_cache.hits++;
+        return tree;
+    }
+    path_cache.misses++;
+    if (tree) path_cache_remove(tree);
+
+    tree = calloc(1, sizeof(PathTree));
+    if (!tree) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    tree->source = source;
+    tree->algorithm = algorithm;
+    tree->radius = INT_MAX;
+    tree->distance = malloc(nodes * sizeof(int));
+    tree->previous = malloc(nodes * sizeof(int));
+    tree->bytes = sizeof(PathTree) + 2 * (size_t)nodes * sizeof(int);
+
+    if (algorithm == ALG_BELLMAN_FORD) {
+        bool* affected = malloc(nodes * sizeof(bool));
+        int* cycle = malloc(nodes * sizeof(int));
+        if (spfa_search(source, tree->distance, tree->previous, affected, cycle, &tree->cycle_length)) {
+            tree->affected = affected;
+            tree->cycle = cycle;
+            tree->bytes += (size_t)nodes * (sizeof(bool) + sizeof(int));
+        } else {
+            free(affected);
+            free(cycle);
+        }
+    } else {
+        if (algorithm == ALG_JOHNSON) {
+            tree->settled = johnson_search(source, target, tree->distance, tree->previous);
+        } else {
+            tree->settled = dijkstra_search(source, target, tree->distance, tree->previous);
+        }
+        // The search stopped at target: only keys up to its own are final
+        if (tree->distance[target] != INT_MAX) {
+            tree->radius = tree->distance[target];
+            if (algorithm == ALG_JOHNSON) {
+                tree->radius += potentials[source] - potentials[target];
+            }
+        }
+    }
+    path_cache_insert(tree);
+    return tree;
+}
+
+// Prints the path from a cached or freshly built tree, with the search
+// effort for misses.
+static void print_tree_path(FILE* out, int start, int end, const PathTree* tree, unsigned long hits) {
+    print_path(out, start, end, tree->distance, tree->previous);
+    if (path_cache.hits > hits) {
+        fprintf(out, "Answered from cached path tree.\n");
+    } else if (tree->algorithm != ALG_BELLMAN_FORD) {
+        fprintf(out, "Computers settled: %d\n", tree->settled);
+    }
+}
+
+static void dynamic_reserve_workspace() {
+    if (dynamic.workspace_size >= nodes) return;
+    int size = dynamic.workspace_size > 0 ? dynamic.workspace_size : 64;
+    while (size < nodes) size *= 2;
+    free(dynamic.affected);
+    free(dynamic.queue);
+    heap_free(&dynamic.heap);
+    dynamic.affected = calloc(size, sizeof(bool));
+    dynamic.queue = malloc(size * sizeof(int));
+    if (!dynamic.affected || !dynamic.queue) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    heap_init(&dynamic.heap, size);
+    dynamic.workspace_size = size;
+}
+
+// Applies the logged route changes to one tree and returns the number of
+// computers settled again. Removals follow Ramalingam-Reps: only the
+// subtrees hanging off removed tree routes lose their distances, are
+// reattached through their best unaffected in-route and re-settled with
+// Dijkstra. Insertions seed the same Dijkstra from the new routes' tails,
+// so the work stays inside the region whose distance actually changed.
+static int repair_watched_tree(WatchedTree* tree) {
+    if (tree->node_count < nodes) {
+        tree->distance = grow_array(tree->distance, nodes, sizeof(int));
+        tree->previous = grow_array(tree->previous, nodes, sizeof(int));
+        for (int v = tree->node_count; v < nodes; v++) {
+            tree->distance[v] = INT_MAX;
+            tree->previous[v] = -1;
+        }
+        tree->node_count = nodes;
+    }
+    if (tree->stale) {
+        tree->stale = false;
+        tree->orphan_count = 0;
+        return dijkstra_search(tree->source, -1, tree->distance, tree->previous);
+    }
+
+    int* distance = tree->distance;
+    int* previous = tree->previous;
+    bool* affected = dynamic.affected;
+    int* queue = dynamic.queue;
+    MinHeap* heap = &dynamic.heap;
+    int count = 0;
+
+    for (int i = 0; i < dynamic.change_count; i++) {
+        RouteChange* change = &dynamic.changes[i];
+        int v = change->destination;
+        if (change->removed && previous[v] == change->source && !affected[v]) {
+            affected[v] = true;
+            queue[count++] = v;
+        }
+    }
+    if (tree->orphan_count > 0) {
+        for (int v = 0; v < nodes; v++) {
+            if (previous[v] == DYNAMIC_ORPHAN && !affected[v]) {
+                affected[v] = true;
+                queue[count++] = v;
+            }
+        }
+        tree->orphan_count = 0;
+    }
+    for (int head = 0; head < count; head++) {
+        int u = queue[head];
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            int v = graph.destinations[e];
+            if (previous[v] == u && !affected[v]) {
+                affected[v] = true;
+                queue[count++] = v;
+            }
+        }
+    }
+
+    // Unaffected computers keep their paths, so they are valid anchors
+    for (int i = 0; i < count; i++) {
+        int v = queue[i];
+        int best = INT_MAX;
+        int parent = -1;
+        for (int e = incoming.offsets[v]; e < incoming.ends[v]; e++) {
+            int u = incoming.destinations[e];
+            if (!affected[u] && distance[u] != INT_MAX && distance[u] + incoming.weights[e] < best) {
+                best = distance[u] + incoming.weights[e];
+                parent = u;
+            }
+        }
+        distance[v] = best;
+        previous[v] = parent;
+    }
+    for (int i = 0; i < count; i++) {
+        int v = queue[i];
+        affected[v] = false;
+        if (distance[v] != INT_MAX) heap_push(heap, v, distance[v]);
+    }
+
+    for (int i = 0; i < dynamic.change_count; i++) {
+        RouteChange* change = &dynamic.changes[i];
+        int u = change->source;
+        if (change->removed || distance[u] == INT_MAX) continue;
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            int v = graph.destinations[e];
+            if (distance[u] + graph.weights[e] < distance[v]) {
+                distance[v] = distance[u] + graph.weights[e];
+                previous[v] = u;
+                heap_push(heap, v, distance[v]);
+            }
+        }
+    }
+
+    int settled = 0;
+    while (heap->size > 0) {
+        int u = heap_pop(heap, NULL);
+        settled++;
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            int v = graph.destinations[e];
+            if (distance[u] + graph.weights[e] < distance[v]) {
+                distance[v] = distance[u] + graph.weights[e];
+                previous[v] = u;
+                heap_push(heap, v, distance[v]);
+            }
+        }
+    }
+    return settled;
+}
+
+// Brings every watched tree up to date; returns the computers re-settled.
+int repair_watched_trees() {
+    if (dynamic.count == 0) return 0;
+    if (negative_routes > 0) {
+        // Dijkstra repairs need non-negative routes; rebuild once they are gone
+        dynamic_mark_stale();
+        return 0;
+    }
+    graph_compact();
+    dynamic_reserve_workspace();
+    int settled = 0;
+    for (int i = 0; i < dynamic.count; i++) {
+        settled += repair_watched_tree(&dynamic.trees[i]);
+    }
+    dynamic.change_count = 0;
+    return settled;
+}
+
+WatchedTree* find_watched_tree(int source) {
+    for (int i = 0; i < dynamic.count; i++) {
+        if (dynamic.trees[i].source == source) return &dynamic.trees[i];
+    }
+    return NULL;
+}
+
+// Starts maintaining the tree of source, or stops if it is already watched.
+void watch_source(FILE* out, int source) {
+    if (!is_valid_computer(source)) {
+        fprintf(out, "Invalid computer index!\n");
+        return;
+    }
+    WatchedTree* existing = find_watched_tree(source);
+    if (existing) {
+        free(existing->distance);
+        free(existing->previous);
+        *existing = dynamic.trees[--dynamic.count];
+        fprintf(out, "Stopped watching computer %d.\n", computer_handle(source));
+        return;
+    }
+
+    if (dynamic.count == dynamic.capacity) {
+        dynamic.capacity = dynamic.capacity > 0 ? dynamic.capacity * 2 : 16;
+        dynamic.trees = grow_array(dynamic.trees, dynamic.capacity, sizeof(WatchedTree));
+    }
+    WatchedTree* tree = &dynamic.trees[dynamic.count++];
+    tree->source = source;
+    tree->stale = true;
+    tree->node_count = 0;
+    tree->orphan_count = 0;
+    tree->distance = NULL;
+    tree->previous = NULL;
+    fprintf(out, "Watching computer %d (%d source%s watched).\n", computer_handle(source), dynamic.count,
+            dynamic.count == 1 ? "" : "s");
+}
+
+void dijkstra(FILE* out, int start, int end) {
+    if (!is_valid_computer(start) || !is_valid_computer(end)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+
+    // Dijkstra's algorithm cannot handle negative weights at all
+    if (has_negative_weights()) {
+        fprintf(out, "\n⚠️  ALGORITHM ERROR\n");
+        fprintf(out, "=====================================\n");
+        fprintf(out, "Dijkstra's algorithm cannot be used with negative edge weights.\n");
+        fprintf(out, "Please use Bellman-Ford or Johnson instead.\n");
+        fprintf(out, "=====================================\n");
+        return;
+    }
+
+    WatchedTree* watchedTree = find_watched_tree(start);
+    if (watchedTree) {
+        int settled = repair_watched_trees();
+        print_path(out, start, end, watchedTree->distance, watchedTree->previous);
+        fprintf(out, "Answered from watched tree (%d computers re-settled).\n", settled);
+        return;
+    }
+
+    unsigned long hits = path_cache.hits;
+    PathTree* tree = shortest_path_tree(start, end, ALG_DIJKSTRA);
+    print_tree_path(out, start, end, tree, hits);
+}
+
+void bellman_ford(FILE* out, int start, int end) {
+    if (!is_valid_computer(start) || !is_valid_computer(end)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+
+    unsigned long hits = path_cache.hits;
+    PathTree* tree = shortest_path_tree(start, end, ALG_BELLMAN_FORD);
+    if (!tree->affected || !report_negative_cycle(out, tree->affected, end, tree->cycle, tree->cycle_length)) {
+        print_tree_path(out, start, end, tree, hits);
+    }
+}
+
+void johnson(FILE* out, int start, int end) {
+    if (!is_valid_computer(start) || !is_valid_computer(end)) {
+        fprintf(out, "Invalid computers!\n");
+        return;
+    }
+    if (!ensure_potentials()) {
+        fprintf(out, "\n⚠️  NEGATIVE WEIGHT CYCLE DETECTED!\n");
+        fprintf(out, "=====================================\n");
+        fprintf(out, "Johnson reweighting is impossible on this network.\n");
+        fprintf(out, "Please use Bellman-Ford to see the affected nodes.\n");
+        fprintf(out, "=====================================\n");
+        return;
+    }
+
+    unsigned long hits = path_cache.hits;
+    PathTree* tree = shortest_path_tree(start, end, ALG_JOHNSON);
+    print_tree_path(out, start, end, tree, hits);
+}
+
+void display_path_cache(FILE* out) {
+    unsigned long lookups = path_cache.hits + path_cache.misses;
+    fprintf(out, "Path cache: %d trees, %.1f of %.1f MB used\n", path_cache.count,
+            path_cache.bytes / 1048576.0, path_cache.budget / 1048576.0);
+    fprintf(out, "Hits: %lu  Misses: %lu  Evictions: %lu  Hit rate: %.1f%%\n",
+            path_cache.hits, path_cache.misses, path_cache.evictions,
+            lookups > 0 ? 100.0 * path_cache.hits / lookups : 0.0);
+}
+
+// Chooses the route of a transfer on a pool worker. The graph stays frozen
+// while transfers are queued or routing; see transfer_quiesce().
+static void route_transfer(Transfer* transfer) {
+    int* distance = malloc(nodes * sizeof(int));
+    int* previous = malloc(nodes * sizeof(int));
+    dijkstra_search(transfer->from, transfer->to, distance, previous);
+
+    transfer->hops = -1;
+    transfer->links = NULL;
+    if (distance[transfer->to] != INT_MAX) {
+        int hops = 0;
+        for (int v = transfer->to; v != transfer->from; v = previous[v]) hops++;
+        transfer->hops = hops;
+        transfer->links = malloc((hops > 0 ? hops : 1) * sizeof(int));
+        int v = transfer->to;
+        for (int h = hops - 1; h >= 0; h--) {
+            int u = previous[v];
+            int best = -1;
+            for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+                if (graph.destinations[e] == v && (best == -1 || graph.weights[e] < graph.weights[best])) {
+                    best = e;
+                }
+            }
+            transfer->links[h] = best;
+            v = u;
+        }
+    }
+    free(distance);
+    free(previous);
+}
+
+static void* transfer_worker(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&transfers.lock);
+    while (1) {
+        while (transfers.count == 0 && !transfers.stopping) {
+            pthread_cond_wait(&transfers.work_ready, &transfers.lock);
+        }
+        if (transfers.count == 0) break;
+
+        Transfer* transfer = transfers.queue[transfers.head];
+        transfers.head = (transfers.head + 1) % transfers.capacity;
+        transfers.count--;
+        transfers.active++;
+        pthread_mutex_unlock(&transfers.lock);
+
+        route_transfer(transfer);
+
+        pthread_mutex_lock(&transfers.lock);
+        transfers.active--;
+        if (transfers.count == 0 && transfers.active == 0) {
+            pthread_cond_broadcast(&transfers.idle);
+        }
+    }
+    pthread_mutex_unlock(&transfers.lock);
+    return NULL;
+}
+
+// Pool size: DSCP_TRANSFER_WORKERS, else the compute worker count.
+static void start_transfer_pool() {
+    const char* configured = getenv("DSCP_TRANSFER_WORKERS");
+    long count = configured ? strtol(configured, NULL, 10) : worker_threads;
+    transfers.thread_count = count > 0 ? (int)count : 1;
+    transfers.threads = malloc(transfers.thread_count * sizeof(pthread_t));
+    for (int i = 0; i < transfers.thread_count; i++) {
+        pthread_create(&transfers.threads[i], NULL, transfer_worker, NULL);
+    }
+    transfers.started = true;
+}
+
+// Queues a transfer for routing and returns without waiting for it. Its
+// packets move once the batch is simulated by "Wait for Transfers".
+void transfer_submit(FILE* out, int from, int to, int packets) {
+    if (!is_valid_computer(from) || !is_valid_computer(to) || packets < 0) {
+        fprintf(out, "Invalid transfer!\n");
+        return;
+    }
+    if (has_negative_weights()) {
+        fprintf(out, "Transfers need non-negative link latencies.\n");
+        return;
+    }
+    // Workers only read the graph, so pending routes are merged here
+    graph_compact();
+
+    Transfer* transfer = malloc(sizeof(Transfer));
+    if (!transfer) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    transfer->from = from;
+    transfer->to = to;
+    transfer->packets = packets;
+
+    pthread_mutex_lock(&transfers.lock);
+    if (!transfers.started) start_transfer_pool();
+    if (transfers.count == transfers.capacity) {
+        // Unwrap the ring into the larger buffer
+        int capacity = transfers.capacity > 0 ? transfers.capacity * 2 : 256;
+        Transfer** queue = malloc(capacity * sizeof(Transfer*));
+        if (!queue) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        for (int i = 0; i < transfers.count; i++) {
+            queue[i] = transfers.queue[(transfers.head + i) % transfers.capacity];
+        }
+        free(transfers.queue);
+        transfers.queue = queue;
+        transfers.head = 0;
+        transfers.capacity = capacity;
+    }
+    if (transfers.batch_count == transfers.batch_capacity) {
+        transfers.batch_capacity = transfers.batch_capacity > 0 ? transfers.batch_capacity * 2 : 256;
+        transfers.batch = grow_array(transfers.batch, transfers.batch_capacity, sizeof(Transfer*));
+    }
+    int id = ++transfers.next_id;
+    transfer->id = id;
+    transfers.batch[transfers.batch_count++] = transfer;
+    transfers.queue[(transfers.head + transfers.count) % transfers.capacity] = transfer;
+    transfers.count++;
+    pthread_cond_signal(&transfers.work_ready);
+    pthread_mutex_unlock(&transfers.lock);
+    if (!quiet) {
+        fprintf(out, "Transfer %d queued: %d packets from %d to %d.\n", id, packets,
+                computer_handle(from), computer_handle(to));
+    }
+}
+
+// Simulates every submitted transfer and reports their completion times.
+void transfer_drain(FILE* out) {
+    transfer_wait_idle();
+    if (!simulate_transfers(out)) {
+        fprintf(out, "No transfers submitted.\n");
+    }
+}
+
+// Finishes outstanding transfers and joins the pool.
+void transfer_shutdown() {
+    transfer_quiesce(stdout);
+    if (!transfers.started) return;
+    pthread_mutex_lock(&transfers.lock);
+    transfers.stopping = true;
+    pthread_cond_broadcast(&transfers.work_ready);
+    pthread_mutex_unlock(&transfers.lock);
+    for (int i = 0; i < transfers.thread_count; i++) {
+        pthread_join(transfers.threads[i], NULL);
+    }
+    free(transfers.threads);
+    transfers.started = false;
+}
+
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_ALIGN 64
+
+enum {
+    SNAP_OFFSETS,
+    SNAP_ENDS,
+    SNAP_DESTINATIONS,
+    SNAP_WEIGHTS,
+    SNAP_SENT,
+    SNAP_RECEIVED,
+    SNAP_INCOMING_OFFSETS,
+    SNAP_INCOMING_ENDS,
+    SNAP_INCOMING_SOURCES,
+    SNAP_INCOMING_WEIGHTS,
+    SNAP_SLOT_STATE,
+    SNAP_FREE_SLOTS,
+    SNAP_LANDMARK_FROM,
+    SNAP_LANDMARK_TO,
+    SNAP_POTENTIALS,
+    SNAP_REWEIGHTED,
+    SNAPSHOT_SECTIONS
+};
+
+// Snapshot file header, zero padded to SNAPSHOT_HEADER_SIZE. Every section
+// is an int32 array in host byte order starting at a multiple of
+// SNAPSHOT_ALIGN and zero padded to the next one; landmark and potential
+// sections have length 0 when they were not built. checksum covers the
+// whole file with the checksum field itself zeroed.
+typedef struct {
+    char magic[8];              // "DSCPSNAP"
+    uint32_t version;
+    uint32_t section_count;
+    int32_t nodes;
+    int32_t routes;             // route slots in destinations/weights
+    int32_t incoming_routes;    // route slots in the incoming index
+    int32_t live_computers;
+    int32_t free_slots;
+    int32_t negative_routes;
+    int32_t landmark_count;
+    uint64_t file_size;
+    uint64_t checksum;
+    uint64_t offset[SNAPSHOT_SECTIONS];
+    uint64_t length[SNAPSHOT_SECTIONS];
+} SnapshotHeader;
+
+#define SNAPSHOT_HEADER_SIZE ((sizeof(SnapshotHeader) + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1))
+
+// Four independent multiply-xorshift lanes over 32-byte blocks, so the
+// check keeps up with reading the mapping. size must be a multiple of 32.
+static void snapshot_hash(uint64_t* lanes, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i += 32) {
+        for (int k = 0; k < 4; k++) {
+            uint64_t word;
+            memcpy(&word, bytes + i + 8 * k, 8);
+            lanes[k] = (lanes[k] ^ word) * 0x9E3779B97F4A7C15ull;
+            lanes[k] ^= lanes[k] >> 29;
+        }
+    }
+}
+
+static uint64_t snapshot_digest(const uint64_t* lanes) {
+    uint64_t digest = 0;
+    for (int k = 0; k < 4; k++) {
+        digest = (digest ^ lanes[k]) * 0xFF51AFD7ED558CCDull;
+        digest ^= digest >> 33;
+    }
+    return digest;
+}
+
+static void snapshot_lanes_init(uint64_t* lanes) {
+    lanes[0] = 0x243F6A8885A308D3ull;
+    lanes[1] = 0x13198A2E03707344ull;
+    lanes[2] = 0xA4093822299F31D0ull;
+    lanes[3] = 0x082EFA98EC4E6C89ull;
+}
+
+static uint64_t snapshot_round(uint64_t size) {
+    return (size + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+// Writes one section plus its padding and feeds both to the checksum.
+static void snapshot_write_section(FILE* file, uint64_t* lanes, const void* data, uint64_t length) {
+    uint64_t whole = length & ~(uint64_t)31;
+    unsigned char tail[128] = {0};
+    if (whole > 0) {
+        fwrite(data, 1, whole, file);
+        snapshot_hash(lanes, data, whole);
+    }
+    uint64_t rest = snapshot_round(length) - whole;
+    if (length > whole) memcpy(tail, (const char*)data + whole, length - whole);
+    fwrite(tail, 1, rest, file);
+    snapshot_hash(lanes, tail, rest);
+}
+
+// Saves the network and every valid index. The file is written next to
+// path and renamed over it, so processes still mapping the old snapshot
+// keep a consistent copy.
+void save_snapshot(FILE* out, const char* path) {
+    transfer_quiesce(out);
+    graph_compact();
+
+    int routes = 0;
+    int incomingRoutes = 0;
+    for (int u = 0; u < nodes; u++) {
+        if (graph.ends[u] > routes) routes = graph.ends[u];
+        if (incoming.ends[u] > incomingRoutes) incomingRoutes = incoming.ends[u];
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DSCPSNAP", 8);
+    header.version = SNAPSHOT_VERSION;
+    header.section_count = SNAPSHOT_SECTIONS;
+    header.nodes = nodes;
+    header.routes = routes;
+    header.incoming_routes = incomingRoutes;
+    header.live_computers = computers.live;
+    header.free_slots = computers.free_count;
+    header.negative_routes = negative_routes;
+
+    const void* data[SNAPSHOT_SECTIONS] = {
+        graph.offsets, graph.ends, graph.destinations, graph.weights,
+        sent_packets, received_packets,
+        incoming.offsets, incoming.ends, incoming.destinations, incoming.weights,
+        computers.state, computers.free_slots
+    };
+    uint64_t nodeBytes = (uint64_t)nodes * sizeof(int);
+    uint64_t routeBytes = (uint64_t)routes * sizeof(int);
+    uint64_t incomingBytes = (uint64_t)incomingRoutes * sizeof(int);
+    header.length[SNAP_OFFSETS] = nodeBytes;
+    header.length[SNAP_ENDS] = nodeBytes;
+    header.length[SNAP_DESTINATIONS] = routeBytes;
+    header.length[SNAP_WEIGHTS] = routeBytes;
+    header.length[SNAP_SENT] = nodeBytes;
+    header.length[SNAP_RECEIVED] = nodeBytes;
+    header.length[SNAP_INCOMING_OFFSETS] = nodeBytes;
+    header.length[SNAP_INCOMING_ENDS] = nodeBytes;
+    header.length[SNAP_INCOMING_SOURCES] = incomingBytes;
+    header.length[SNAP_INCOMING_WEIGHTS] = incomingBytes;
+    header.length[SNAP_SLOT_STATE] = nodeBytes;
+    header.length[SNAP_FREE_SLOTS] = (uint64_t)computers.free_count * sizeof(int);
+    if (landmarks_valid) {
+        header.landmark_count = landmark_count;
+        data[SNAP_LANDMARK_FROM] = landmark_from;
+        data[SNAP_LANDMARK_TO] = landmark_to;
+        header.length[SNAP_LANDMARK_FROM] = nodeBytes * landmark_count;
+        header.length[SNAP_LANDMARK_TO] = nodeBytes * landmark_count;
+    }
+    if (potentials_valid && !potentials_cycle) {
+        data[SNAP_POTENTIALS] = potentials;
+        data[SNAP_REWEIGHTED] = reweighted;
+        header.length[SNAP_POTENTIALS] = nodeBytes;
+        header.length[SNAP_REWEIGHTED] = routeBytes;
+    }
+    uint64_t position = SNAPSHOT_HEADER_SIZE;
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+        header.offset[i] = position;
+        position += snapshot_round(header.length[i]);
+    }
+    header.file_size = position;
+
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE* file = fopen(temporary, "wb");
+    if (!file) {
+        fprintf(out, "Error: Could not open %s for writing.\n", temporary);
+        return;
+    }
+    uint64_t lanes[4];
+    snapshot_lanes_init(lanes);
+    snapshot_write_section(file, lanes, &header, sizeof(header));
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+        snapshot_write_section(file, lanes, data[i], header.length[i]);
+    }
+    header.checksum = snapshot_digest(lanes);
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    bool written = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written || rename(temporary, path) != 0) {
+        fprintf(out, "Error: Could not write %s.\n", path);
+        remove(temporary);
+        return;
+    }
+    fprintf(out, "Snapshot saved to %s: %d computers, %d route slots, %.1f MB.\n",
+            path, computers.live, routes, header.file_size / 1048576.0);
+}
+
+static bool snapshot_section_valid(const SnapshotHeader* header, int section, uint64_t expected) {
+    return header->offset[section] % SNAPSHOT_ALIGN == 0 &&
+           header->offset[section] <= header->file_size &&
+           header->length[section] <= header->file_size - header->offset[section] &&
+           (header->length[section] == expected || (section >= SNAP_LANDMARK_FROM && header->length[section] == 0));
+}
+
+// Checks that every row of a route index lies within the route slots and
+// names only computers in the snapshot. Rows are not required to be in
+// order: emptied rows are reset to 0 .. 0 and stay that way until the next
+// compaction.
+static bool snapshot_rows_valid(const char* base, const SnapshotHeader* header,
+                                int offsetSection, int endSection, int targetSection, int routes) {
+    const int* offsets = (const int*)(base + header->offset[offsetSection]);
+    const int* ends = (const int*)(base + header->offset[endSection]);
+    const int* targets = (const int*)(base + header->offset[targetSection]);
+    for (int u = 0; u < header->nodes; u++) {
+        if (offsets[u] < 0 || ends[u] < offsets[u] || ends[u] > routes) return false;
+        for (int i = offsets[u]; i < ends[u]; i++) {
+            if (targets[i] < 0 || targets[i] >= header->nodes) return false;
+        }
+    }
+    return true;
+}
+
+// Checks that no slot state has a negative generation, that the header's
+// live count matches the states, and that each free slot is a distinct
+// removed slot.
+static bool snapshot_slots_valid(const char* base, const SnapshotHeader* header) {
+    const int* state = (const int*)(base + header->offset[SNAP_SLOT_STATE]);
+    const int* freeSlots = (const int*)(base + header->offset[SNAP_FREE_SLOTS]);
+    int live = 0;
+    for (int s = 0; s < header->nodes; s++) {
+        if (state[s] < 0) return false;
+        live += state[s] & 1;
+    }
+    if (live != header->live_computers) return false;
+
+    bool* listed = calloc(header->nodes > 0 ? header->nodes : 1, sizeof(bool));
+    if (!listed) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+    bool valid = true;
+    for (int i = 0; i < header->free_slots && valid; i++) {
+        int slot = freeSlots[i];
+        valid = slot >= 0 && slot < header->nodes && !(state[slot] & 1) && !listed[slot];
+        if (valid) listed[slot] = true;
+    }
+    free(listed);
+    return valid;
+}
+
+// Checks that saved landmark distances and Johnson potentials still hold
+// for every route u -> x of latency w, so A* and Johnson stay exact:
+// d(L, x) <= d(L, u) + w and d(u, L) <= w + d(x, L) for each landmark L,
+// and each reweighted latency is w + h(u) - h(x) and not negative.
+static bool snapshot_bounds_valid(const char* base, const SnapshotHeader* header) {
+    const int* offsets = (const int*)(base + header->offset[SNAP_OFFSETS]);
+    const int* ends = (const int*)(base + header->offset[SNAP_ENDS]);
+    const int* destinations = (const int*)(base + header->offset[SNAP_DESTINATIONS]);
+    const int* weights = (const int*)(base + header->offset[SNAP_WEIGHTS]);
+    const int* from = (const int*)(base + header->offset[SNAP_LANDMARK_FROM]);
+    const int* to = (const int*)(base + header->offset[SNAP_LANDMARK_TO]);
+    const int* potential = (const int*)(base + header->offset[SNAP_POTENTIALS]);
+    const int* reweight = (const int*)(base + header->offset[SNAP_REWEIGHTED]);
+    int count = header->length[SNAP_LANDMARK_FROM] > 0 ? header->landmark_count : 0;
+    bool hasPotentials = header->length[SNAP_POTENTIALS] > 0;
+
+    for (long long i = 0; i < (long long)header->nodes * count; i++) {
+        if (from[i] < 0 || to[i] < 0) return false;
+    }
+    for (int u = 0; u < header->nodes; u++) {
+        for (int e = offsets[u]; e < ends[u]; e++) {
+            int x = destinations[e];
+            for (int k = 0; k < count; k++) {
+                int fromU = from[u * count + k];
+                int toX = to[x * count + k];
+                if (fromU != INT_MAX && from[x * count + k] > (long long)fromU + weights[e]) return false;
+                if (toX != INT_MAX && to[u * count + k] > (long long)weights[e] + toX) return false;
+            }
+            if (hasPotentials &&
+                (reweight[e] < 0 || reweight[e] != (long long)weights[e] + potential[u] - potential[x])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Checks that the mapped file is a complete snapshot of this version whose
+// route indexes can be walked without leaving the mapping.
+static bool snapshot_valid(const char* base, size_t size) {
+    if (size < SNAPSHOT_HEADER_SIZE || size % SNAPSHOT_ALIGN != 0) return false;
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, "DSCPSNAP", 8) != 0 || header.version != SNAPSHOT_VERSION ||
+        header.section_count != SNAPSHOT_SECTIONS || header.file_size != size ||
+        header.nodes < 0 || header.routes < 0 || header.incoming_routes < 0 || header.landmark_count < 0 ||
+        header.live_computers < 0 || header.free_slots < 0 || header.free_slots > header.nodes ||
+        header.landmark_count > ALT_LANDMARKS) {
+        return false;
+    }
+
+    uint64_t nodeBytes = (uint64_t)header.nodes * sizeof(int);
+    uint64_t routeBytes = (uint64_t)header.routes * sizeof(int);
+    uint64_t incomingBytes = (uint64_t)header.incoming_routes * sizeof(int);
+    uint64_t expected[SNAPSHOT_SECTIONS] = {
+        nodeBytes, nodeBytes, routeBytes, routeBytes, nodeBytes, nodeBytes,
+        nodeBytes, nodeBytes, incomingBytes, incomingBytes,
+        nodeBytes, (uint64_t)header.free_slots * sizeof(int),
+        nodeBytes * header.landmark_count, nodeBytes * header.landmark_count, nodeBytes, routeBytes
+    };
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+        if (!snapshot_section_valid(&header, i, expected[i])) return false;
+    }
+
+    uint64_t checksum = header.checksum;
+    header.checksum = 0;
+    uint64_t lanes[4];
+    snapshot_lanes_init(lanes);
+    unsigned char padded[SNAPSHOT_HEADER_SIZE];
+    memcpy(padded, base, SNAPSHOT_HEADER_SIZE);
+    memcpy(padded, &header, sizeof(header));
+    snapshot_hash(lanes, padded, SNAPSHOT_HEADER_SIZE);
+    snapshot_hash(lanes, base + SNAPSHOT_HEADER_SIZE, size - SNAPSHOT_HEADER_SIZE);
+    if (snapshot_digest(lanes) != checksum) return false;
+
+    return snapshot_rows_valid(base, &header, SNAP_OFFSETS, SNAP_ENDS, SNAP_DESTINATIONS, header.routes) &&
+           snapshot_rows_valid(base, &header, SNAP_INCOMING_OFFSETS, SNAP_INCOMING_ENDS, SNAP_INCOMING_SOURCES,
+                               header.incoming_routes) &&
+           snapshot_slots_valid(base, &header) && snapshot_bounds_valid(base, &header);
+}
+
+// Replaces the network with a snapshot. The file is mapped privately, so
+// nothing is parsed or copied up front, several processes can share the
+// same pages, and later changes stay local to this process.
+bool load_snapshot(FILE* out, const char* path) {
+    struct timespec wallStart, wallEnd;
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(out, "Error: Could not open %s.\n", path);
+        return false;
+    }
+    struct stat info;
+    char* base = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)SNAPSHOT_HEADER_SIZE) {
+        base = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(out, "Error: %s is not a network snapshot.\n", path);
+        return false;
+    }
+    if (!snapshot_valid(base, info.st_size)) {
+        munmap(base, info.st_size);
+        fprintf(out, "Error: %s is damaged or not a version %d snapshot.\n", path, SNAPSHOT_VERSION);
+        return false;
+    }
+
+    // Drop the current network, including anything borrowed from an
+    // earlier snapshot, before that mapping goes away
+    transfer_quiesce(out);
+    dynamic_clear();
+    release_array(graph.offsets);
+    release_array(graph.ends);
+    release_array(graph.destinations);
+    release_array(graph.weights);
+    release_array(sent_packets);
+    release_array(received_packets);
+    release_array(incoming.offsets);
+    release_array(incoming.ends);
+    release_array(incoming.destinations);
+    release_array(incoming.weights);
+    release_array(computers.state);
+    release_array(computers.free_slots);
+    release_array(landmark_from);
+    release_array(landmark_to);
+    release_array(potentials);
+    release_array(reweighted);
+    if (snapshot.base) munmap(snapshot.base, snapshot.size);
+    snapshot.base = base;
+    snapshot.size = info.st_size;
+
+    const SnapshotHeader* header = (const SnapshotHeader*)base;
+    int** arrays[SNAPSHOT_SECTIONS] = {
+        &graph.offsets, &graph.ends, &graph.destinations, &graph.weights,
+        (int**)&sent_packets, (int**)&received_packets,
+        &incoming.offsets, &incoming.ends, &incoming.destinations, &incoming.weights,
+        &computers.state, &computers.free_slots,
+        &landmark_from, &landmark_to, &potentials, &reweighted
+    };
+    for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+        *arrays[i] = header->length[i] > 0 ? (int*)(base + header->offset[i]) : NULL;
+    }
+    nodes = header->nodes;
+    node_capacity = nodes;
+    // Counted from the loaded routes rather than taken from the header
+    negative_routes = 0;
+    for (int u = 0; u < nodes; u++) {
+        for (int e = graph.offsets[u]; e < graph.ends[u]; e++) {
+            if (graph.weights[e] < 0) negative_routes++;
+        }
     }
+    computers.live = header->live_computers;
+    computers.free_count = header->free_slots;
+    computers.free_capacity = header->free_slots;
+    graph.delta_count = 0;
+    incoming.delta_count = 0;
+    ensure_node_capacity(INITIAL_NODE_CAPACITY);
+
+    graph_changed();
+    landmarks_valid = header->length[SNAP_LANDMARK_FROM] > 0;
+    landmark_count = header->landmark_count;
+    potentials_valid = header->length[SNAP_POTENTIALS] > 0;
+    potentials_cycle = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+    double seconds = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+    if (!quiet) {
+        fprintf(out, "Snapshot loaded from %s: %d computers, %d route slots in %.2fms%s%s.\n",
+                path, computers.live, header->routes, seconds * 1000,
+                landmarks_valid ? ", landmarks" : "",
+                potentials_valid ? ", potentials" : "");
+    }
+    return true;
 }
 
-void add_computer() {
-    if (nodes < MAX_NODES) {
-        nodes++;
-        printf("Computer %d added to the network.\n", nodes - 1);
-    } else {
-        printf("Network limit reached!\n");
+void clear_network(FILE* out) {
+    transfer_quiesce(out);
+    nodes = 0;
+    graph.delta_count = 0;
+    incoming.delta_count = 0;
+    negative_routes = 0;
+    for (int i = 0; i < node_capacity; i++) {
+        graph.offsets[i] = 0;
+        graph.ends[i] = 0;
+        incoming.offsets[i] = 0;
+        incoming.ends[i] = 0;
+        sent_packets[i] = 0;
+        received_packets[i] = 0;
+        computers.state[i] = 0;
+    }
+    // A cleared network starts numbering from 0 again
+    computers.free_count = 0;
+    computers.live = 0;
+    dynamic_clear();
+    graph_changed();
+    if (!quiet) fprintf(out, "Network cleared!\n");
+}
+
+// Worker count for the parallel engines: DSCP_THREADS, else one per core.
+void configure_worker_threads() {
+    const char* configured = getenv("DSCP_THREADS");
+    long count = configured ? strtol(configured, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    worker_threads = count > 0 ? (int)count : 1;
+}
+
+// Path cache budget: DSCP_PATH_CACHE_MB, else PATH_CACHE_BUDGET_MB.
+void configure_path_cache() {
+    const char* configured = getenv("DSCP_PATH_CACHE_MB");
+    long megabytes = configured ? strtol(configured, NULL, 10) : PATH_CACHE_BUDGET_MB;
+    path_cache.budget = (size_t)(megabytes > 0 ? megabytes : 0) * 1048576;
+}
+
+// Upper bound of the bucket holding the given quantile, in histogram units.
+static long long histogram_quantile(const HistogramTotals* histogram, double quantile) {
+    long long rank = (long long)(quantile * histogram->count + 0.999999);
+    long long seen = 0;
+    for (int b = 0; b < METRIC_BUCKETS - 1; b++) {
+        seen += histogram->buckets[b];
+        if (seen >= rank) return 1LL << b;
+    }
+    return 1LL << (METRIC_BUCKETS - 1);
+}
+
+void display_metrics(FILE* out) {
+    MetricTotals totals;
+    metrics_collect(&totals);
+    fprintf(out, "\nQuery Metrics (merged from %d threads):\n", totals.threads);
+    fprintf(out, "%-22s %8s %10s %10s %10s %12s %12s %12s\n", "Algorithm", "Queries", "Mean(us)", "p50(us)",
+            "p99(us)", "Settled/q", "Relaxed/q", "Heap ops/q");
+    bool any = false;
+    for (int a = 0; a < METRIC_ALGORITHMS; a++) {
+        const HistogramTotals* latency = &totals.latency[a];
+        if (latency->count == 0) continue;
+        any = true;
+        char median[24], tail[24];
+        snprintf(median, sizeof(median), "<=%lld", histogram_quantile(latency, 0.5));
+        snprintf(tail, sizeof(tail), "<=%lld", histogram_quantile(latency, 0.99));
+        fprintf(out, "%-22s %8lld %10.1f %10s %10s %12.1f %12.1f %12.1f\n", metric_algorithm_names[a],
+                latency->count, (double)latency->sum / latency->count, median, tail,
+                (double)totals.settled[a] / latency->count, (double)totals.relaxed[a] / latency->count,
+                (double)totals.heap_operations[a] / latency->count);
+    }
+    if (!any) fprintf(out, "No queries yet.\n");
+
+    const HistogramTotals* transferTime = &totals.transfer_time;
+    fprintf(out, "Transfers: %lld completed, %lld packets, %lld bytes", transferTime->count, totals.transfer_packets,
+            totals.transfer_bytes);
+    if (transferTime->count > 0) {
+        fprintf(out, ", mean %.1fms, p99 <=%lldms (simulated)", (double)transferTime->sum / transferTime->count,
+                histogram_quantile(transferTime, 0.99));
+    }
+    fprintf(out, "\n");
+    if (metrics.path) fprintf(out, "Exported every %ds to %s\n", metrics.interval, metrics.path);
+}
+
+static void write_histogram(FILE* file, const char* name, const char* labels, const HistogramTotals* histogram,
+                            double scale) {
+    long long cumulative = 0;
+    for (int b = 0; b < METRIC_BUCKETS; b++) {
+        cumulative += histogram->buckets[b];
+        if (b < METRIC_BUCKETS - 1) {
+            fprintf(file, "%s_bucket{%s%sle=\"%g\"} %lld\n", name, labels, *labels ? "," : "",
+                    (double)(1LL << b) * scale, cumulative);
+        } else {
+            fprintf(file, "%s_bucket{%s%sle=\"+Inf\"} %lld\n", name, labels, *labels ? "," : "", cumulative);
+        }
+    }
+    const char* braces = *labels ? "{" : "";
+    const char* closing = *labels ? "}" : "";
+    fprintf(file, "%s_sum%s%s%s %g\n", name, braces, labels, closing, histogram->sum * scale);
+    fprintf(file, "%s_count%s%s%s %lld\n", name, braces, labels, closing, histogram->count);
+}
+
+static void write_algorithm_counter(FILE* file, const char* name, const char* help, const long long* values) {
+    fprintf(file, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int a = 0; a < METRIC_ALGORITHMS; a++) {
+        fprintf(file, "%s{algorithm=\"%s\"} %lld\n", name, metric_algorithm_names[a], values[a]);
+    }
+}
+
+// Writes the merged counters in Prometheus text format. The file is
+// replaced through a rename, so a scraper never reads half of it.
+bool write_metrics(const char* path) {
+    MetricTotals totals;
+    metrics_collect(&totals);
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE* file = fopen(temporary, "w");
+    if (!file) return false;
+
+    write_algorithm_counter(file, "dscp_nodes_settled_total", "Computers settled by shortest path searches.",
+                            totals.settled);
+    write_algorithm_counter(file, "dscp_edges_relaxed_total", "Routes scanned by shortest path searches.",
+                            totals.relaxed);
+    write_algorithm_counter(file, "dscp_heap_operations_total", "Priority queue pushes and pops.",
+                            totals.heap_operations);
+    fprintf(file, "# HELP dscp_query_duration_seconds Wall time of shortest path searches.\n");
+    fprintf(file, "# TYPE dscp_query_duration_seconds histogram\n");
+    for (int a = 0; a < METRIC_ALGORITHMS; a++) {
+        char labels[64];
+        snprintf(labels, sizeof(labels), "algorithm=\"%s\"", metric_algorithm_names[a]);
+        write_histogram(file, "dscp_query_duration_seconds", labels, &totals.latency[a], 1e-6);
+    }
+    fprintf(file, "# HELP dscp_transfer_duration_seconds Simulated time from start to last packet delivered.\n");
+    fprintf(file, "# TYPE dscp_transfer_duration_seconds histogram\n");
+    write_histogram(file, "dscp_transfer_duration_seconds", "", &totals.transfer_time, 1e-3);
+    fprintf(file, "# HELP dscp_transfer_packets_total Packets delivered by simulated transfers.\n");
+    fprintf(file, "# TYPE dscp_transfer_packets_total counter\ndscp_transfer_packets_total %lld\n",
+            totals.transfer_packets);
+    fprintf(file, "# HELP dscp_transfer_bytes_total Bytes delivered by simulated transfers.\n");
+    fprintf(file, "# TYPE dscp_transfer_bytes_total counter\ndscp_transfer_bytes_total %lld\n",
+            totals.transfer_bytes);
+    fprintf(file, "# HELP dscp_metric_threads Threads that have reported metrics.\n");
+    fprintf(file, "# TYPE dscp_metric_threads gauge\ndscp_metric_threads %d\n", totals.threads);
+
+    bool written = fclose(file) == 0;
+    if (!written || rename(temporary, path) != 0) {
+        unlink(temporary);
+        return false;
     }
+    return true;
 }
 
-void remove_computer(int comp) {
-    if (comp >= 0 && comp < nodes) {
-        for (int i = comp; i < nodes - 1; i++) {
-            graph[i] = graph[i + 1];
-            sent_packets[i] = sent_packets[i + 1];
-            received_packets[i] = received_packets[i + 1];
+static void* metrics_dumper(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&metrics.lock);
+    while (!metrics.stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += metrics.interval;
+        while (!metrics.stopping &&
+               pthread_cond_timedwait(&metrics.wake, &metrics.lock, &deadline) == 0) {
+        }
+        pthread_mutex_unlock(&metrics.lock);
+        if (!write_metrics(metrics.path)) {
+            fprintf(stderr, "Cannot write metrics to %s.\n", metrics.path);
         }
-        nodes--;
-        printf("Computer %d removed from the network.\n", comp);
+        pthread_mutex_lock(&metrics.lock);
+    }
+    pthread_mutex_unlock(&metrics.lock);
+    return NULL;
+}
+
+// Starts exporting to path every DSCP_METRICS_INTERVAL seconds, else
+// every METRICS_INTERVAL_SECONDS.
+void start_metrics_export(const char* path) {
+    const char* configured = getenv("DSCP_METRICS_INTERVAL");
+    long seconds = configured ? strtol(configured, NULL, 10) : METRICS_INTERVAL_SECONDS;
+    metrics.interval = seconds > 0 ? (int)seconds : METRICS_INTERVAL_SECONDS;
+    metrics.path = path;
+    metrics.dumping = pthread_create(&metrics.dumper, NULL, metrics_dumper, NULL) == 0;
+}
+
+// Stops the export thread, which writes the file one last time.
+void stop_metrics_export() {
+    if (!metrics.dumping) return;
+    pthread_mutex_lock(&metrics.lock);
+    metrics.stopping = true;
+    pthread_cond_signal(&metrics.wake);
+    pthread_mutex_unlock(&metrics.lock);
+    pthread_join(metrics.dumper, NULL);
+    metrics.dumping = false;
+}
+
+#define BATCH_BUFFER_SIZE (1 << 20)
+
+// A shortest path query waiting in a batch group. Filled in by
+// batch_answer_source(); path lists the computers from start to end.
+typedef struct {
+    int start;
+    int end;
+    int distance;       // INT_MAX when unreachable
+    int length;
+    int* path;
+} BatchQuery;
+
+typedef struct {
+    BatchQuery* queries;
+    int count;
+    int capacity;
+    int* order;         // query indexes sorted by start
+    int* sources;       // first index into order of each distinct start
+    int source_count;
+    atomic_int next_source;
+    bool reweighted;    // negative routes: search with Johnson potentials
+} BatchGroup;
+
+BatchGroup batch_group;
+
+static int batch_compare_start(const void* a, const void* b) {
+    const BatchQuery* x = &batch_group.queries[*(const int*)a];
+    const BatchQuery* y = &batch_group.queries[*(const int*)b];
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return *(const int*)a - *(const int*)b;
+}
+
+// Answers every grouped query of one start with a single search. A lone
+// query stops at its target; several share the full tree.
+static void batch_answer_source(int first, int last, int* distance, int* previous) {
+    int start = batch_group.queries[batch_group.order[first]].start;
+    int target = last - first == 1 ? batch_group.queries[batch_group.order[first]].end : -1;
+    if (batch_group.reweighted) {
+        johnson_search(start, target, distance, previous);
     } else {
-        printf("Invalid computer index!\n");
+        MetricMark mark = metrics_start();
+        heap_search(nodes, graph.offsets, graph.ends, graph.destinations, graph.weights,
+                    start, target, distance, previous);
+        metrics_finish(METRIC_DIJKSTRA, mark);
+    }
+
+    for (int i = first; i < last; i++) {
+        BatchQuery* query = &batch_group.queries[batch_group.order[i]];
+        query->distance = distance[query->end];
+        query->length = 0;
+        query->path = NULL;
+        if (query->distance == INT_MAX) continue;
+        for (int v = query->end; v != -1; v = previous[v]) query->length++;
+        query->path = malloc(query->length * sizeof(int));
+        int slot = query->length;
+        for (int v = query->end; v != -1; v = previous[v]) query->path[--slot] = v;
     }
 }
 
-void add_route(int u, int v, int weight) {
-    if (u < nodes && v < nodes && u != v) {
-        // Add only forward edge (directed graph)
-        Edge* newEdge = (Edge*)malloc(sizeof(Edge));
-        newEdge->destination = v;
-        newEdge->weight = weight;
-        newEdge->next = graph[u];
-        graph[u] = newEdge;
+static void* batch_query_worker(void* arg) {
+    (void)arg;
+    int* distance = malloc(nodes * sizeof(int));
+    int* previous = malloc(nodes * sizeof(int));
+    while (1) {
+        int s = atomic_fetch_add(&batch_group.next_source, 1);
+        if (s >= batch_group.source_count) break;
+        int last = s + 1 < batch_group.source_count ? batch_group.sources[s + 1] : batch_group.count;
+        batch_answer_source(batch_group.sources[s], last, distance, previous);
+    }
+    free(distance);
+    free(previous);
+    return NULL;
+}
 
-        printf("Route added: %d -> %d with latency %dms.\n", u, v, weight);
+// Runs the grouped queries, one search per distinct start spread over the
+// worker threads, and prints the answers in submission order.
+void batch_flush_queries(FILE* out) {
+    if (batch_group.count == 0) return;
+    int count = batch_group.count;
+    bool cycle = false;
+    batch_group.reweighted = has_negative_weights();
+    if (batch_group.reweighted) {
+        cycle = !ensure_potentials();
     } else {
-        printf("Invalid computers!\n");
+        graph_compact();
+    }
+
+    if (!cycle) {
+        batch_group.order = grow_array(batch_group.order, count, sizeof(int));
+        batch_group.sources = grow_array(batch_group.sources, count, sizeof(int));
+        for (int i = 0; i < count; i++) batch_group.order[i] = i;
+        qsort(batch_group.order, count, sizeof(int), batch_compare_start);
+        batch_group.source_count = 0;
+        for (int i = 0; i < count; i++) {
+            if (i == 0 || batch_group.queries[batch_group.order[i]].start !=
+                          batch_group.queries[batch_group.order[i - 1]].start) {
+                batch_group.sources[batch_group.source_count++] = i;
+            }
+        }
+
+        atomic_store(&batch_group.next_source, 0);
+        int threadCount = worker_threads < batch_group.source_count ? worker_threads : batch_group.source_count;
+        pthread_t* threads = malloc(threadCount * sizeof(pthread_t));
+        for (int t = 1; t < threadCount; t++) {
+            pthread_create(&threads[t], NULL, batch_query_worker, NULL);
+        }
+        batch_query_worker(NULL);
+        for (int t = 1; t < threadCount; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        free(threads);
+    }
+
+    for (int i = 0; i < count; i++) {
+        BatchQuery* query = &batch_group.queries[i];
+        int start = computer_handle(query->start);
+        int end = computer_handle(query->end);
+        if (cycle) {
+            fprintf(out, "%d -> %d: negative cycle\n", start, end);
+        } else if (query->distance == INT_MAX) {
+            fprintf(out, "%d -> %d: no path\n", start, end);
+        } else {
+            fprintf(out, "%d -> %d: %dms via", start, end, query->distance);
+            for (int k = 0; k < query->length; k++) fprintf(out, " %d", computer_handle(query->path[k]));
+            fprintf(out, "\n");
+            free(query->path);
+        }
     }
+    batch_group.count = 0;
 }
 
-void display_network() {
-    printf("\nCurrent Network:\n");
-    for (int i = 0; i < nodes; i++) {
-        printf("Computer %d -> ", i);
-        Edge* temp = graph[i];
-        while (temp) {
-            printf("%d(%dms) ", temp->destination, temp->weight);
-            temp = temp->next;
+static void batch_add_query(int start, int end) {
+    if (batch_group.count == batch_group.capacity) {
+        batch_group.capacity = batch_group.capacity > 0 ? batch_group.capacity * 2 : 1024;
+        batch_group.queries = grow_array(batch_group.queries, batch_group.capacity, sizeof(BatchQuery));
+    }
+    BatchQuery* query = &batch_group.queries[batch_group.count++];
+    query->start = start;
+    query->end = end;
+}
+
+static const char* batch_skip_space(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+// Parses a decimal integer at *cursor; lines always end in '\n', which
+// stops every scan.
+static bool batch_int(const char** cursor, int* value) {
+    const char* p = batch_skip_space(*cursor);
+    bool negative = *p == '-';
+    if (negative) p++;
+    if (*p < '0' || *p > '9') return false;
+    long long result = 0;
+    while (*p >= '0' && *p <= '9') {
+        result = result * 10 + (*p++ - '0');
+        if (result > INT_MAX) return false;
+    }
+    *value = (int)(negative ? -result : result);
+    *cursor = p;
+    return true;
+}
+
+static bool batch_keyword(const char* word, int length, const char* keyword) {
+    return (int)strlen(keyword) == length && memcmp(word, keyword, length) == 0;
+}
+
+// Applies one command line. Returns false if it was malformed.
+static bool batch_command(FILE* out, const char* p) {
+    p = batch_skip_space(p);
+    if (*p == '\n' || *p == '#') return true;
+
+    int a, b, c;
+    // Bare "u v latency" lines form an edge list; missing computers are added
+    if ((*p >= '0' && *p <= '9') || *p == '-') {
+        if (!batch_int(&p, &a) || !batch_int(&p, &b) || !batch_int(&p, &c)) return false;
+        if (a < 0 || b < 0) return false;
+        batch_flush_queries(out);
+        // Only plain slot numbers past the end create computers; anything
+        // else must resolve, so a handle's generation never sizes the network
+        bool newA = (a & ~HANDLE_SLOT_MASK) == 0 && a >= nodes;
+        bool newB = (b & ~HANDLE_SLOT_MASK) == 0 && b >= nodes;
+        if ((!newA && resolve_computer(out, a) < 0) || (!newB && resolve_computer(out, b) < 0)) return false;
+        if (newA || newB) {
+            int last = newA ? a & HANDLE_SLOT_MASK : -1;
+            if (newB && (b & HANDLE_SLOT_MASK) > last) last = b & HANDLE_SLOT_MASK;
+            transfer_quiesce(out);
+            while (nodes <= last) open_slot(nodes);
+            graph_changed();
+        }
+        add_route(out, resolve_computer(out, a), resolve_computer(out, b), c);
+        return *batch_skip_space(p) == '\n';
+    }
+
+    const char* word = p;
+    while (*p >= 'a' && *p <= 'z') p++;
+    int length = (int)(p - word);
+    if (batch_keyword(word, length, "path")) {
+        if (!batch_int(&p, &a) || !batch_int(&p, &b)) return false;
+        a = resolve_computer(out, a);
+        b = resolve_computer(out, b);
+        if (batch_int(&p, &c) && c != 1) {
+            // Other algorithms answer one at a time, as in the menu
+            batch_flush_queries(out);
+            if (c == 2) bellman_ford(out, a, b);
+            else if (c == 3 || c == 4) point_to_point(out, a, b, c);
+            else if (c == 5) hierarchy_query(out, a, b);
+            else if (c == 6 || c == 7) parallel_shortest_path(out, a, b, c == 7);
+            else if (c == 8) johnson(out, a, b);
+            else if (c == 9) apsp_query(out, a, b);
+            else return false;
+        } else if (!is_valid_computer(a) || !is_valid_computer(b)) {
+            batch_flush_queries(out);
+            fprintf(out, "Invalid computers!\n");
+        } else {
+            batch_add_query(a, b);
+        }
+        return *batch_skip_space(p) == '\n';
+    }
+
+    batch_flush_queries(out);
+    if (batch_keyword(word, length, "computer")) {
+        int count = 1;
+        if (batch_int(&p, &count) && count < 0) return false;
+        for (int i = 0; i < count; i++) add_computer(out);
+    } else if (batch_keyword(word, length, "remove")) {
+        if (!batch_int(&p, &a)) return false;
+        remove_computer(out, resolve_computer(out, a));
+    } else if (batch_keyword(word, length, "route")) {
+        if (!batch_int(&p, &a) || !batch_int(&p, &b) || !batch_int(&p, &c)) return false;
+        add_route(out, resolve_computer(out, a), resolve_computer(out, b), c);
+    } else if (batch_keyword(word, length, "unroute")) {
+        if (!batch_int(&p, &a) || !batch_int(&p, &b)) return false;
+        remove_route(out, resolve_computer(out, a), resolve_computer(out, b));
+    } else if (batch_keyword(word, length, "transfer")) {
+        if (!batch_int(&p, &a) || !batch_int(&p, &b) || !batch_int(&p, &c)) return false;
+        transfer_submit(out, resolve_computer(out, a), resolve_computer(out, b), c);
+    } else if (batch_keyword(word, length, "wait")) {
+        transfer_drain(out);
+    } else if (batch_keyword(word, length, "show")) {
+        display_network(out);
+    } else if (batch_keyword(word, length, "clear")) {
+        clear_network(out);
+    } else if (batch_keyword(word, length, "renumber")) {
+        compact_computers(out);
+    } else if (batch_keyword(word, length, "stats")) {
+        display_metrics(out);
+    } else if (batch_keyword(word, length, "save") || batch_keyword(word, length, "load")) {
+        char filename[256];
+        p = batch_skip_space(p);
+        int nameLength = 0;
+        while (*p != '\n' && *p != ' ' && *p != '\t' && *p != '\r' && nameLength < 255) {
+            filename[nameLength++] = *p++;
+        }
+        filename[nameLength] = '\0';
+        if (nameLength == 0) return false;
+        if (*word == 's') {
+            save_snapshot(out, filename);
+        } else if (!load_snapshot(out, filename)) {
+            return false;
         }
-        printf("| Sent: %d | Received: %d\n", sent_packets[i], received_packets[i]);
+    } else {
+        return false;
     }
+    return *batch_skip_space(p) == '\n';
 }
 
-bool has_negative_weights() {
-    for (int i = 0; i < nodes; i++) {
-        Edge* temp = graph[i];
-        while (temp) {
-            if (temp->weight < 0) {
-                return true;
+// Reads commands from path ("-" for stdin) in large blocks, with mutation
+// confirmations suppressed. Consecutive path queries are answered together
+// when the next non-query command or the end of input is reached. Returns
+// the number of malformed lines.
+int run_batch(const char* path) {
+    FILE* input = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!input) {
+        printf("Cannot open %s\n", path);
+        return -1;
+    }
+    char* buffer = malloc(BATCH_BUFFER_SIZE + 1);
+    if (!buffer) {
+        printf("Out of memory!\n");
+        exit(1);
+    }
+
+    struct timespec wallStart, wallEnd;
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    quiet = true;
+    long long lines = 0;
+    int errors = 0;
+    size_t filled = 0;
+    bool done = false;
+    while (!done) {
+        size_t got = fread(buffer + filled, 1, BATCH_BUFFER_SIZE - filled, input);
+        filled += got;
+        if (got == 0) {
+            // A last line without its newline
+            done = true;
+            if (filled == 0) break;
+            buffer[filled++] = '\n';
+        }
+
+        char* line = buffer;
+        char* end = buffer + filled;
+        char* newline;
+        while ((newline = memchr(line, '\n', end - line)) != NULL) {
+            lines++;
+            if (!batch_command(stdout, line)) {
+                errors++;
+                printf("Line %lld: bad command: %.*s\n", lines, (int)(newline - line), line);
             }
-            temp = temp->next;
+            line = newline + 1;
+        }
+        filled = end - line;
+        if (filled == BATCH_BUFFER_SIZE) {
+            printf("Line %lld: longer than %d bytes\n", lines + 1, BATCH_BUFFER_SIZE);
+            errors++;
+            break;
         }
+        memmove(buffer, line, filled);
     }
-    return false;
+    batch_flush_queries(stdout);
+    quiet = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+    double seconds = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+    if (seconds <= 0) seconds = 1e-9;
+    printf("Batch: %lld lines in %.3fs (%.2fM lines/s), %d computers, %d errors.\n",
+           lines, seconds, lines / seconds / 1e6, computers.live, errors);
+    free(buffer);
+    if (input != stdin) fclose(input);
+    return errors;
 }
 
-void dijkstra(int start, int end) {
-    // Dijkstra's algorithm cannot handle negative weights at all
-    if (has_negative_weights()) {
-        printf("\n⚠️  ALGORITHM ERROR\n");
-        printf("=====================================\n");
-        printf("Dijkstra's algorithm cannot be used with negative edge weights.\n");
-        printf("Please use Bellman-Ford algorithm instead.\n");
-        printf("=====================================\n");
-        return;
+#define SERVER_LINE_LIMIT 4096
+#define SERVER_READ_SIZE 65536
+#define SERVER_PIPELINE_DEPTH 256
+#define SERVER_MAX_EVENTS 256
+#define SERVER_PUBLISH_LAG 64   // commands a view may trail by under a steady write stream
+
+struct ServerConnection;
+
+// One request line and, once a worker has run it, its response: the
+// command's output followed by "OK" or "ERR ...".
+typedef struct ServerJob {
+    struct ServerConnection* connection;
+    struct ServerJob* next;             // connection's requests in order
+    struct ServerJob* next_queued;      // worker queue
+    char* response;
+    size_t response_length;
+    bool done;
+    bool query;                         // "path from to" on a published view
+    bool publish;                       // command: no command follows it yet
+    int from;
+    int to;
+    unsigned long version;              // query: oldest view it may use;
+                                        // command: graph_version after it
+    char line[];                        // '\n' terminated
+} ServerJob;
+
+// A client. Requests may be pipelined; responses are written back in
+// request order even when workers finish them out of order. Reading
+// pauses while SERVER_PIPELINE_DEPTH requests are in flight.
+typedef struct ServerConnection {
+    int fd;                 // -1 once closed
+    char* input;
+    size_t input_length;
+    size_t input_capacity;
+    char* output;
+    size_t output_length;
+    size_t output_sent;
+    size_t output_capacity;
+    ServerJob* first;       // oldest request whose response is not yet written
+    ServerJob* last;
+    ServerJob* pending;     // first request not yet handed to a worker
+    int in_flight;
+    int running;            // handed to a worker and not done
+    bool command_running;
+    unsigned long version;  // graph_version after its last command
+    bool closing;           // client sent EOF: close once answered
+    bool reading;           // EPOLLIN wanted
+    bool writing;           // EPOLLOUT wanted
+    bool ready;             // on the ready list
+    struct ServerConnection* next_ready;
+    struct ServerConnection* next_closed;
+} ServerConnection;
+
+// Query server on a Unix domain socket. The event loop thread owns the
+// sockets and buffers; workers run requests. Path queries run on the
+// published graph view without locks. Every other command changes the
+// live network under the write lock, and views are published after a run
+// of commands, so queries never wait for them.
+typedef struct {
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;            // eventfd: workers finished a request
+    int signal_fd;          // SIGINT/SIGTERM stop the server
+    pthread_mutex_t write_lock;
+    atomic_int writers_waiting;
+    int unpublished;        // commands since the last publish
+    pthread_mutex_t lock;   // queue, job state and the ready list
+    pthread_cond_t work_ready;
+    ServerJob* queue_head;
+    ServerJob* queue_tail;
+    ServerConnection* ready;
+    ServerConnection* closed;   // freed by the event loop once nothing runs
+    pthread_t* threads;
+    int thread_count;
+    bool stopping;
+    int clients;
+    int connections;
+    long long requests;
+} QueryServer;
+
+QueryServer server = {
+    .write_lock = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work_ready = PTHREAD_COND_INITIALIZER
+};
+
+// Per-worker search arrays, grown to the current slot count.
+typedef struct {
+    int* distance;
+    int* previous;
+    int capacity;
+} ServerWorkspace;
+
+// Recognises "path from to" and "path from to 1", which run on a view.
+static bool server_parse_query(const char* line, int* from, int* to) {
+    const char* p = batch_skip_space(line);
+    const char* word = p;
+    while (*p >= 'a' && *p <= 'z') p++;
+    int algorithm;
+    if (!batch_keyword(word, (int)(p - word), "path")) return false;
+    if (!batch_int(&p, from) || !batch_int(&p, to)) return false;
+    if (batch_int(&p, &algorithm) && algorithm != 1) return false;
+    return *batch_skip_space(p) == '\n';
+}
+
+// Answers a path query from the current view, formatted like batch mode.
+static void server_query(ServerJob* job, ServerWorkspace* workspace) {
+    FILE* out = open_memstream(&job->response, &job->response_length);
+    const GraphView* view = view_pin();
+    if (!view || view->version < job->version) {
+        // A command sent earlier on this connection is not published yet
+        view_unpin();
+        pthread_mutex_lock(&server.write_lock);
+        view_publish();
+        server.unpublished = 0;
+        pthread_mutex_unlock(&server.write_lock);
+        view = view_pin();
+    }
+    if (workspace->capacity < view->nodes) {
+        workspace->capacity = view->nodes;
+        workspace->distance = grow_array(workspace->distance, workspace->capacity, sizeof(int));
+        workspace->previous = grow_array(workspace->previous, workspace->capacity, sizeof(int));
     }
 
-    int distance[MAX_NODES];
-    int previous[MAX_NODES];
-    bool visited[MAX_NODES];
-    
-    for (int i = 0; i < nodes; i++) {
-        distance[i] = INT_MAX;
-        previous[i] = -1;
-        visited[i] = false;
+    int start = view_resolve(view, job->from, out);
+    int end = view_resolve(view, job->to, out);
+    if (start < 0 || end < 0) {
+        fprintf(out, "Invalid computers!\n");
+    } else if (view->cycle) {
+        fprintf(out, "%d -> %d: negative cycle\n", job->from, job->to);
+    } else {
+        int* distance = workspace->distance;
+        int* previous = workspace->previous;
+        view_search(view, start, end, distance, previous);
+        if (distance[end] == INT_MAX) {
+            fprintf(out, "%d -> %d: no path\n", job->from, job->to);
+        } else {
+            int length = 0;
+            for (int v = end; v != -1; v = previous[v]) length++;
+            int* path = malloc(length * sizeof(int));
+            int slot = length;
+            for (int v = end; v != -1; v = previous[v]) path[--slot] = v;
+            fprintf(out, "%d -> %d: %dms via", job->from, job->to, distance[end]);
+            for (int k = 0; k < length; k++) fprintf(out, " %d", view_handle(view, path[k]));
+            fprintf(out, "\n");
+            free(path);
+        }
     }
-    distance[start] = 0;
-    
-    for (int count = 0; count < nodes - 1; count++) {
-        int min = INT_MAX, minIndex = -1;
-        for (int v = 0; v < nodes; v++) {
-            if (!visited[v] && distance[v] <= min) {
-                min = distance[v];
-                minIndex = v;
+    view_unpin();
+    fprintf(out, "OK\n");
+    fclose(out);
+}
+
+// Runs any batch command under the write lock, capturing what it prints.
+static void server_command(ServerJob* job) {
+    atomic_fetch_add(&server.writers_waiting, 1);
+    pthread_mutex_lock(&server.write_lock);
+    atomic_fetch_sub(&server.writers_waiting, 1);
+    FILE* out = open_memstream(&job->response, &job->response_length);
+    bool ok = batch_command(out, job->line);
+    batch_flush_queries(out);
+
+    const char* p = batch_skip_space(job->line);
+    const char* word = p;
+    while (*p >= 'a' && *p <= 'z') p++;
+    if (ok && batch_keyword(word, (int)(p - word), "stats")) {
+        pthread_mutex_lock(&server.lock);
+        fprintf(out, "Server: %d clients connected, %d connections, %lld requests\n",
+                server.clients, server.connections, server.requests);
+        pthread_mutex_unlock(&server.lock);
+        fprintf(out, "Views: %lld published, %lld reclaimed, %d waiting for readers\n",
+                views.published, views.reclaimed, views.retired_count);
+    }
+    fprintf(out, ok ? "OK\n" : "ERR bad command\n");
+    fclose(out);
+
+    // Commands already waiting for the lock publish for this one
+    job->version = graph_version;
+    server.unpublished++;
+    if ((job->publish && atomic_load(&server.writers_waiting) == 0) ||
+        server.unpublished >= SERVER_PUBLISH_LAG) {
+        view_publish();
+        server.unpublished = 0;
+    }
+    pthread_mutex_unlock(&server.write_lock);
+}
+
+static void* server_worker(void* arg) {
+    (void)arg;
+    ServerWorkspace workspace = {0};
+    pthread_mutex_lock(&server.lock);
+    while (1) {
+        while (!server.queue_head && !server.stopping) {
+            pthread_cond_wait(&server.work_ready, &server.lock);
+        }
+        if (!server.queue_head) break;
+        ServerJob* job = server.queue_head;
+        server.queue_head = job->next_queued;
+        if (!server.queue_head) server.queue_tail = NULL;
+        pthread_mutex_unlock(&server.lock);
+
+        if (job->query) server_query(job, &workspace);
+        else server_command(job);
+
+        pthread_mutex_lock(&server.lock);
+        job->done = true;
+        ServerConnection* connection = job->connection;
+        connection->running--;
+        if (!job->query) {
+            connection->command_running = false;
+            connection->version = job->version;
+        }
+        if (!connection->ready) {
+            connection->ready = true;
+            connection->next_ready = server.ready;
+            server.ready = connection;
+            uint64_t one = 1;
+            if (write(server.wake_fd, &one, sizeof(one)) < 0) {
+                // The counter is already non-zero, so the loop will wake anyway
             }
         }
-        if (minIndex == -1) break;
-        visited[minIndex] = true;
+    }
+    pthread_mutex_unlock(&server.lock);
+    free(workspace.distance);
+    free(workspace.previous);
+    return NULL;
+}
+
+static void server_watch(ServerConnection* connection) {
+    struct epoll_event event = {0};
+    event.events = (connection->reading ? EPOLLIN : 0) | (connection->writing ? EPOLLOUT : 0);
+    event.data.ptr = connection;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+static void server_free(ServerConnection* connection) {
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+}
+
+// Stops serving a client. Requests still running finish first, and the
+// connection is freed by server_sweep() once the last one is collected.
+static void server_close(ServerConnection* connection) {
+    if (connection->fd == -1) return;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    server.clients--;
+    connection->next_closed = server.closed;
+    server.closed = connection;
+}
+
+static void server_sweep() {
+    ServerConnection** link = &server.closed;
+    while (*link) {
+        ServerConnection* connection = *link;
+        if (connection->in_flight == 0) {
+            *link = connection->next_closed;
+            server_free(connection);
+        } else {
+            link = &connection->next_closed;
+        }
+    }
+}
+
+// Hands the connection's requests to the workers in order. Queries run
+// side by side, but a command waits for the requests before it and holds
+// back the ones after it, so every request sees the commands sent before it.
+static void server_dispatch(ServerConnection* connection) {
+    pthread_mutex_lock(&server.lock);
+    bool queued = false;
+    while (connection->pending) {
+        ServerJob* job = connection->pending;
+        if (connection->command_running || (!job->query && connection->running > 0)) break;
+        connection->pending = job->next;
+        connection->running++;
+        if (job->query) {
+            job->version = connection->version;
+        } else {
+            connection->command_running = true;
+            job->publish = !job->next || job->next->query;
+        }
+        if (server.queue_tail) server.queue_tail->next_queued = job;
+        else server.queue_head = job;
+        server.queue_tail = job;
+        server.requests++;
+        queued = true;
+    }
+    if (queued) pthread_cond_broadcast(&server.work_ready);
+    pthread_mutex_unlock(&server.lock);
+}
+
+// Takes the complete lines in the input buffer as requests, up to the
+// pipeline depth. Returns false if the client sent a line over
+// SERVER_LINE_LIMIT.
+static bool server_parse(ServerConnection* connection) {
+    size_t used = 0;
+    while (connection->in_flight < SERVER_PIPELINE_DEPTH) {
+        char* line = connection->input + used;
+        char* newline = memchr(line, '\n', connection->input_length - used);
+        if (!newline) break;
+        size_t length = newline - line + 1;
+        ServerJob* job = malloc(sizeof(ServerJob) + length + 1);
+        if (!job) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        memcpy(job->line, line, length);
+        job->line[length] = '\0';
+        job->connection = connection;
+        job->next = NULL;
+        job->next_queued = NULL;
+        job->response = NULL;
+        job->response_length = 0;
+        job->done = false;
+        job->query = server_parse_query(job->line, &job->from, &job->to);
+        job->publish = false;
+        job->version = 0;
+        if (connection->last) connection->last->next = job;
+        else connection->first = job;
+        connection->last = job;
+        if (!connection->pending) connection->pending = job;
+        connection->in_flight++;
+        used += length;
+    }
+    memmove(connection->input, connection->input + used, connection->input_length - used);
+    connection->input_length -= used;
+    server_dispatch(connection);
+
+    bool paused = connection->in_flight >= SERVER_PIPELINE_DEPTH;
+    return paused || connection->input_length <= SERVER_LINE_LIMIT;
+}
+
+static void server_flush(ServerConnection* connection) {
+    while (connection->output_sent < connection->output_length) {
+        ssize_t sent = send(connection->fd, connection->output + connection->output_sent,
+                            connection->output_length - connection->output_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            server_close(connection);
+            return;
+        }
+        connection->output_sent += sent;
+    }
+    if (connection->output_sent == connection->output_length) {
+        connection->output_sent = 0;
+        connection->output_length = 0;
+        if (connection->closing && connection->in_flight == 0) {
+            server_close(connection);
+            return;
+        }
+    }
+    bool writing = connection->output_length > 0;
+    bool reading = !connection->closing && connection->in_flight < SERVER_PIPELINE_DEPTH;
+    if (writing != connection->writing || reading != connection->reading) {
+        connection->writing = writing;
+        connection->reading = reading;
+        server_watch(connection);
+    }
+}
+
+static void server_read(ServerConnection* connection) {
+    if (connection->input_capacity - connection->input_length < SERVER_READ_SIZE) {
+        connection->input_capacity = connection->input_length + SERVER_READ_SIZE;
+        connection->input = grow_array(connection->input, connection->input_capacity, 1);
+    }
+    ssize_t got = recv(connection->fd, connection->input + connection->input_length, SERVER_READ_SIZE, 0);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (got < 0) {
+        server_close(connection);
+        return;
+    }
+    // On EOF the requests already sent are still answered
+    if (got == 0) connection->closing = true;
+    connection->input_length += got;
+    if (!server_parse(connection)) {
+        server_close(connection);
+        return;
+    }
+    server_flush(connection);
+}
+
+// Moves finished responses, in request order, to the output buffers.
+static void server_collect() {
+    pthread_mutex_lock(&server.lock);
+    ServerConnection* ready = server.ready;
+    server.ready = NULL;
+    pthread_mutex_unlock(&server.lock);
+
+    while (ready) {
+        ServerConnection* connection = ready;
+        ready = connection->next_ready;
+        while (1) {
+            pthread_mutex_lock(&server.lock);
+            ServerJob* job = connection->first;
+            bool done = job && job->done;
+            // Stays listed until nothing is left to collect, so it is never
+            // queued twice or freed while queued
+            if (!done) connection->ready = false;
+            pthread_mutex_unlock(&server.lock);
+            if (!done) break;
 
-        Edge* temp = graph[minIndex];
-        while (temp) {
-            if (!visited[temp->destination] && distance[minIndex] + temp->weight < distance[temp->destination]) {
-                distance[temp->destination] = distance[minIndex] + temp->weight;
-                previous[temp->destination] = minIndex;
+            connection->first = job->next;
+            if (!connection->first) connection->last = NULL;
+            connection->in_flight--;
+            if (connection->fd != -1) {
+                size_t needed = connection->output_length + job->response_length;
+                if (needed > connection->output_capacity) {
+                    connection->output_capacity = needed * 2;
+                    connection->output = grow_array(connection->output, connection->output_capacity, 1);
+                }
+                memcpy(connection->output + connection->output_length, job->response, job->response_length);
+                connection->output_length = needed;
             }
-            temp = temp->next;
+            free(job->response);
+            free(job);
+        }
+        if (connection->fd == -1) {
+            // Requests of a closed client still run, in order
+            server_dispatch(connection);
+            continue;
         }
+        if (!server_parse(connection)) {
+            server_close(connection);
+            continue;
+        }
+        server_flush(connection);
     }
+}
 
-    printf("\nShortest path from %d to %d: %dms\n", start, end, distance[end]);
-    printf("Path: ");
-    int current = end;
-    while (current != -1) {
-        printf("%d <- ", current);
-        current = previous[current];
+static void server_accept() {
+    while (1) {
+        int fd = accept(server.listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ServerConnection* connection = calloc(1, sizeof(ServerConnection));
+        if (!connection) {
+            printf("Out of memory!\n");
+            exit(1);
+        }
+        connection->fd = fd;
+        connection->reading = true;
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        server.clients++;
+        server.connections++;
     }
-    printf("END\n");
 }
 
-void* data_transfer(void* arg) {
-    int* params = (int*)arg;
-    int from = params[0];
-    int to = params[1];
-    int packets = params[2];
-    sent_packets[from] += packets;
-    received_packets[to] += packets;
-    for (int i = 0; i <= 100; i += 10) {
-        printf("Data transfer: %d%%\n", i);
-        Sleep(5 * packets);  // Sleep takes milliseconds
+static bool server_listen(const char* path) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        return false;
     }
-    printf("Data transfer complete: %d packets sent from %d to %d.\n", packets, from, to);
-    return NULL;
+    strcpy(address.sun_path, path);
+
+    // A socket left behind by a previous run would make bind fail
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server.listen_fd < 0 || bind(server.listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server.listen_fd, SOMAXCONN) != 0) {
+        printf("Cannot listen on %s\n", path);
+        if (server.listen_fd >= 0) close(server.listen_fd);
+        return false;
+    }
+    return true;
 }
 
-void clear_network() {
-    initialize_graph();
-    nodes = 0;
-    for (int i = 0; i < MAX_NODES; i++) {
-        sent_packets[i] = 0;
-        received_packets[i] = 0;
+// Serves the in-memory network on a Unix domain socket until SIGINT or
+// SIGTERM. The protocol is batch mode, one command per line; every
+// response ends with an "OK" or "ERR ..." line.
+int run_server(const char* path) {
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    // Blocked before any thread starts, so only the signalfd sees them
+    pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    if (!server_listen(path)) return 1;
+
+    quiet = true;
+    view_publish();
+
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server.signal_fd = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.ptr = &server.listen_fd;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+    event.data.ptr = &server.wake_fd;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.wake_fd, &event);
+    event.data.ptr = &server.signal_fd;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.signal_fd, &event);
+
+    server.thread_count = worker_threads;
+    server.threads = malloc(server.thread_count * sizeof(pthread_t));
+    for (int i = 0; i < server.thread_count; i++) {
+        pthread_create(&server.threads[i], NULL, server_worker, NULL);
+    }
+    printf("Serving %d computers on %s with %d workers.\n", computers.live, path, server.thread_count);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    bool running = true;
+    while (running) {
+        int count = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR) break;
+        bool collect = false;
+        for (int i = 0; i < count; i++) {
+            void* source = events[i].data.ptr;
+            if (source == &server.listen_fd) {
+                server_accept();
+            } else if (source == &server.wake_fd) {
+                uint64_t wakes;
+                if (read(server.wake_fd, &wakes, sizeof(wakes)) < 0) {
+                    // Already drained by an earlier event in this round
+                }
+                collect = true;
+            } else if (source == &server.signal_fd) {
+                running = false;
+            } else {
+                ServerConnection* connection = source;
+                if (connection->fd == -1) continue;
+                if (events[i].events & EPOLLIN) {
+                    server_read(connection);
+                } else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    server_close(connection);
+                }
+                if (connection->fd != -1 && (events[i].events & EPOLLOUT)) server_flush(connection);
+            }
+        }
+        if (collect) server_collect();
+        server_sweep();
+    }
+
+    pthread_mutex_lock(&server.lock);
+    server.stopping = true;
+    pthread_cond_broadcast(&server.work_ready);
+    pthread_mutex_unlock(&server.lock);
+    for (int i = 0; i < server.thread_count; i++) {
+        pthread_join(server.threads[i], NULL);
     }
-    printf("Network cleared!\n");
+    free(server.threads);
+    close(server.listen_fd);
+    close(server.wake_fd);
+    close(server.signal_fd);
+    close(server.epoll_fd);
+    unlink(path);
+    quiet = false;
+    printf("Server stopped: %lld requests from %d connections.\n", server.requests, server.connections);
+    return 0;
 }
 
-int main() {
+// dscp_bench.c includes this file with DSCP_NO_MAIN to drive the engines
+// without the menu.
+#ifndef DSCP_NO_MAIN
+int main(int argc, char** argv) {
     initialize_graph();
+    configure_worker_threads();
+    configure_path_cache();
+    const char* batchPath = NULL;
+    const char* metricsPath = NULL;
+    const char* servePath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            if (!load_snapshot(stdout, argv[++i])) return 1;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batchPath = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            servePath = argv[++i];
+        } else {
+            printf("Usage: %s [--snapshot FILE] [--batch FILE|-] [--metrics FILE] [--serve SOCKET]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (metricsPath) start_metrics_export(metricsPath);
+    if (batchPath || servePath) {
+        // A batch run before --serve preloads the network
+        int errors = batchPath ? run_batch(batchPath) : 0;
+        int status = errors == 0 ? 0 : 1;
+        if (servePath) status = run_server(servePath);
+        transfer_shutdown();
+        stop_metrics_export();
+        return status;
+    }
     while (1) {
         printf("\nMenu:\n");
         printf("1. Add Computer\n");
@@ -180,166 +5134,126 @@ int main() {
         printf("6. Transfer Data\n");
         printf("7. Clear Network\n");
         printf("8. Exit\n");
+        printf("9. Build Route Hierarchy\n");
+        printf("10. All-Pairs Latency Matrix\n");
+        printf("11. Export Latency Matrix\n");
+        printf("12. Path Cache Statistics\n");
+        printf("13. Remove Route\n");
+        printf("14. Watch/Unwatch Source\n");
+        printf("15. Wait for Transfers\n");
+        printf("16. Save Snapshot\n");
+        printf("17. Load Snapshot\n");
+        printf("18. Renumber Computers\n");
+        printf("19. Query Metrics\n");
         
         int choice;
         printf("Enter your choice: ");
-        scanf("%d", &choice);
+        if (scanf("%d", &choice) != 1) {
+            if (feof(stdin)) {
+                // Input closed: leave instead of re-reading the menu forever
+                transfer_shutdown();
+                stop_metrics_export();
+                break;
+            }
+            scanf("%*s");
+            choice = 0;
+        }
         
         if (choice == 1) {
-            add_computer();
+            add_computer(stdout);
         } else if (choice == 2) {
             int comp;
             printf("Enter computer index to remove: ");
             scanf("%d", &comp);
-            remove_computer(comp);
+            remove_computer(stdout, resolve_computer(stdout, comp));
         } else if (choice == 3) {
             int u, v, weight;
             printf("Enter two computers and latency (ms): ");
             scanf("%d %d %d", &u, &v, &weight);
-            add_route(u, v, weight);
+            add_route(stdout, resolve_computer(stdout, u), resolve_computer(stdout, v), weight);
         } else if (choice == 4) {
-            display_network();
+            display_network(stdout);
         } else if (choice == 5) {
             int start, end;
             printf("Enter source and destination computers: ");
             scanf("%d %d", &start, &end);
-            printf("Choose algorithm: 1. Dijkstra  2. Bellman-Ford\n");
+            start = resolve_computer(stdout, start);
+            end = resolve_computer(stdout, end);
+            printf("Choose algorithm: 1. Dijkstra  2. Bellman-Ford  3. Bidirectional Dijkstra  4. A* (landmarks)  5. Contraction Hierarchy\n");
+            printf("                  6. Parallel Bellman-Ford  7. Delta-Stepping  8. Johnson  9. All-Pairs Matrix\n");
             int alg;
             printf("Enter choice: ");
             scanf("%d", &alg);
             if (alg == 1) {
-                dijkstra(start, end);
+                dijkstra(stdout, start, end);
             } else if (alg == 2) {
-                bellman_ford(start, end);
+                bellman_ford(stdout, start, end);
+            } else if (alg == 3 || alg == 4) {
+                point_to_point(stdout, start, end, alg);
+            } else if (alg == 5) {
+                hierarchy_query(stdout, start, end);
+            } else if (alg == 6 || alg == 7) {
+                parallel_shortest_path(stdout, start, end, alg == 7);
+            } else if (alg == 8) {
+                johnson(stdout, start, end);
+            } else if (alg == 9) {
+                apsp_query(stdout, start, end);
             } else {
                 printf("Invalid algorithm choice! Defaulting to Dijkstra.\n");
-                dijkstra(start, end);
+                dijkstra(stdout, start, end);
             }
         } else if (choice == 6) {
             int from, to, packets;
             printf("Enter source, destination, and packets: ");
             scanf("%d %d %d", &from, &to, &packets);
-            int params[3] = {from, to, packets};
-            pthread_t thread;
-            pthread_create(&thread, NULL, data_transfer, params);
-            pthread_join(thread, NULL);
+            transfer_submit(stdout, resolve_computer(stdout, from), resolve_computer(stdout, to), packets);
         } else if (choice == 7) {
-            clear_network();
+            clear_network(stdout);
         } else if (choice == 8) {
+            transfer_shutdown();
+            stop_metrics_export();
             printf("Exiting...\n");
             break;
+        } else if (choice == 9) {
+            build_hierarchy(stdout);
+        } else if (choice == 10) {
+            display_latency_matrix(stdout);
+        } else if (choice == 11) {
+            char filename[256];
+            printf("Enter output file name: ");
+            scanf("%255s", filename);
+            export_latency_matrix(stdout, filename);
+        } else if (choice == 12) {
+            display_path_cache(stdout);
+        } else if (choice == 13) {
+            int u, v;
+            printf("Enter source and destination computers: ");
+            scanf("%d %d", &u, &v);
+            remove_route(stdout, resolve_computer(stdout, u), resolve_computer(stdout, v));
+        } else if (choice == 14) {
+            int source;
+            printf("Enter computer index to watch: ");
+            scanf("%d", &source);
+            watch_source(stdout, resolve_computer(stdout, source));
+        } else if (choice == 15) {
+            transfer_drain(stdout);
+        } else if (choice == 18) {
+            compact_computers(stdout);
+        } else if (choice == 19) {
+            display_metrics(stdout);
+        } else if (choice == 16 || choice == 17) {
+            char filename[256];
+            printf("Enter snapshot file name: ");
+            scanf("%255s", filename);
+            if (choice == 16) {
+                save_snapshot(stdout, filename);
+            } else {
+                load_snapshot(stdout, filename);
+            }
         } else {
             printf("Invalid choice!\n");
         }
     }
     return 0;
 }
-
-void bellman_ford(int start, int end) {
-    int distance[MAX_NODES];
-    int previous[MAX_NODES];
-
-    for (int i = 0; i < nodes; i++) {
-        distance[i] = INT_MAX;
-        previous[i] = -1;
-    }
-    distance[start] = 0;
-
-    // Relax edges repeatedly
-    for (int iter = 0; iter < nodes - 1; iter++) {
-        bool updated = false;
-        for (int u = 0; u < nodes; u++) {
-            if (distance[u] == INT_MAX) continue;
-            Edge* e = graph[u];
-            while (e) {
-                int v = e->destination;
-                int w = e->weight;
-                if (distance[u] + w < distance[v]) {
-                    distance[v] = distance[u] + w;
-                    previous[v] = u;
-                    updated = true;
-                }
-                e = e->next;
-            }
-        }
-        if (!updated) break; // no change -> stop early
-    }
-
-    // Check for negative weight cycles and identify affected nodes
-    bool negCycle = false;
-    bool affected[MAX_NODES] = {false};
-    int affectedCount = 0;
-    
-    for (int u = 0; u < nodes; u++) {
-        if (distance[u] == INT_MAX) continue;
-        Edge* e = graph[u];
-        while (e) {
-            int v = e->destination;
-            int w = e->weight;
-            if (distance[u] + w < distance[v]) {
-                negCycle = true;
-                
-                // Mark all nodes reachable from v as affected using BFS
-                bool visited[MAX_NODES] = {false};
-                int queue[MAX_NODES];
-                int front = 0, rear = 0;
-                queue[rear++] = v;
-                visited[v] = true;
-                
-                while (front < rear) {
-                    int node = queue[front++];
-                    if (!affected[node]) {
-                        affected[node] = true;
-                        affectedCount++;
-                    }
-                    
-                    Edge* edge = graph[node];
-                    while (edge) {
-                        if (!visited[edge->destination]) {
-                            visited[edge->destination] = true;
-                            queue[rear++] = edge->destination;
-                        }
-                        edge = edge->next;
-                    }
-                }
-            }
-            e = e->next;
-        }
-        if (negCycle) break;
-    }
-
-    if (negCycle) {
-        printf("\n⚠️  NEGATIVE WEIGHT CYCLE DETECTED!\n");
-        printf("=====================================\n");
-        printf("Shortest paths are UNDEFINED for affected nodes.\n");
-        printf("Reason: You can loop infinitely to reduce path weight.\n");
-        printf("\nAffected nodes: ");
-        for (int i = 0; i < nodes; i++) {
-            if (affected[i]) {
-                printf("%d ", i);
-            }
-        }
-        printf("\n\nRecommendation: Remove negative weight edges or restructure the network.\n");
-        printf("=====================================\n");
-        
-        if (affected[end]) {
-            printf("\nDestination node %d is affected by the negative cycle.\n", end);
-            printf("Cannot compute shortest path - it would be -∞ (negative infinity).\n");
-            return;
-        }
-    }
-
-    if (distance[end] == INT_MAX) {
-        printf("\nNo path from %d to %d found.\n", start, end);
-        return;
-    }
-
-    printf("\nShortest path from %d to %d: %dms\n", start, end, distance[end]);
-    printf("Path: ");
-    int current = end;
-    while (current != -1) {
-        printf("%d <- ", current);
-        current = previous[current];
-    }
-    printf("END\n");
-}
\ No newline at end of file
+#endif
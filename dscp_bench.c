@@ -0,0 +1,664 @@
+#define DSCP_NO_MAIN
+#include "dscp.c"
+
+#define BENCH_DEFAULT_EDGES "1000,100000"
+#define BENCH_MIN_EDGES 100
+#define BENCH_MAX_EDGES 10000000
+#define BENCH_MAX_LATENCY 100
+#define BENCH_CYCLE_LENGTH 8
+#define BENCH_SCALE_FREE_LINKS 2
+#define BENCH_SLOW_ROUTES 10000
+#define BENCH_NOISE_MS 0.002
+#define BENCH_VIEW_PASSES 4
+
+enum {
+    TOPOLOGY_RANDOM,
+    TOPOLOGY_GRID,
+    TOPOLOGY_SCALE_FREE,
+    TOPOLOGY_NEGATIVE_CYCLE,
+    TOPOLOGIES
+};
+
+const char* topology_names[TOPOLOGIES] = {"random", "grid", "scalefree", "cycle"};
+
+// Timings of one phase on one generated network, in milliseconds. Every
+// sample covers `items` operations (routes for a build, transfers for a
+// transfer batch, 1 for a query).
+typedef struct {
+    const char* topology;
+    long edges;         // requested size
+    int nodes;
+    int routes;         // routes actually generated
+    const char* phase;
+    double* samples;
+    int count;
+    int capacity;
+    int items;
+} BenchResult;
+
+// Percentiles of a result, as written to and read back from JSON.
+typedef struct {
+    char topology[16];
+    long edges;
+    char phase[32];
+    int samples;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+} BenchSummary;
+
+BenchResult* bench_results = NULL;
+int bench_count = 0;
+int bench_capacity = 0;
+
+uint64_t bench_state = 1;
+int bench_slow_routes = BENCH_SLOW_ROUTES;
+FILE* bench_quiet = NULL;   // /dev/null, for engine output during timed runs
+
+// splitmix64, so a seed gives the same networks on every machine.
+static uint64_t bench_random() {
+    uint64_t z = (bench_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int bench_below(int limit) {
+    return (int)(bench_random() % (uint64_t)limit);
+}
+
+static double bench_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+static BenchResult* bench_result(int topology, long edges, const char* phase, int items) {
+    for (int i = 0; i < bench_count; i++) {
+        BenchResult* result = &bench_results[i];
+        if (result->edges == edges && strcmp(result->topology, topology_names[topology]) == 0 &&
+            strcmp(result->phase, phase) == 0) {
+            return result;
+        }
+    }
+    if (bench_count == bench_capacity) {
+        bench_capacity = bench_capacity > 0 ? bench_capacity * 2 : 32;
+        bench_results = grow_array(bench_results, bench_capacity, sizeof(BenchResult));
+    }
+    BenchResult* result = &bench_results[bench_count++];
+    memset(result, 0, sizeof(*result));
+    result->topology = topology_names[topology];
+    result->edges = edges;
+    result->phase = phase;
+    result->items = items;
+    return result;
+}
+
+static void bench_record(int topology, long edges, const char* phase, int items, double milliseconds) {
+    BenchResult* result = bench_result(topology, edges, phase, items);
+    if (result->count == result->capacity) {
+        result->capacity = result->capacity > 0 ? result->capacity * 2 : 16;
+        result->samples = grow_array(result->samples, result->capacity, sizeof(double));
+    }
+    result->samples[result->count++] = milliseconds;
+    result->nodes = computers.live;
+    result->routes = 0;
+    for (int u = 0; u < nodes; u++) {
+        result->routes += graph.ends[u] - graph.offsets[u];
+    }
+}
+
+static int bench_compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile: the smallest sample with at least p% of the
+// samples at or below it, i.e. index ceil(p * count / 100) - 1.
+static double bench_percentile(const double* sorted, int count, int p) {
+    long long rank = ((long long)p * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static BenchSummary bench_summarize(BenchResult* result) {
+    BenchSummary summary;
+    memset(&summary, 0, sizeof(summary));
+    snprintf(summary.topology, sizeof(summary.topology), "%s", result->topology);
+    snprintf(summary.phase, sizeof(summary.phase), "%s", result->phase);
+    summary.edges = result->edges;
+    summary.samples = result->count;
+    if (result->count == 0) return summary;
+
+    qsort(result->samples, result->count, sizeof(double), bench_compare_double);
+    double total = 0;
+    for (int i = 0; i < result->count; i++) {
+        total += result->samples[i];
+    }
+    summary.mean = total / result->count;
+    summary.p50 = bench_percentile(result->samples, result->count, 50);
+    summary.p90 = bench_percentile(result->samples, result->count, 90);
+    summary.p99 = bench_percentile(result->samples, result->count, 99);
+    summary.max = result->samples[result->count - 1];
+    return summary;
+}
+
+static void bench_add_computers(int count) {
+    for (int i = 0; i < count; i++) {
+        add_computer(bench_quiet);
+    }
+}
+
+static void bench_random_routes(int n, long count) {
+    for (long i = 0; i < count; i++) {
+        int u = bench_below(n);
+        int v = bench_below(n - 1);
+        if (v >= u) v++;
+        add_route(bench_quiet, u, v, 1 + bench_below(BENCH_MAX_LATENCY));
+    }
+}
+
+// Square grid with routes both ways between neighbours.
+static void bench_grid(long edges) {
+    int side = 2;
+    while ((long)(side + 1) * side * 4 <= edges) side++;
+    bench_add_computers(side * side);
+    for (int row = 0; row < side; row++) {
+        for (int column = 0; column < side; column++) {
+            int v = row * side + column;
+            if (column + 1 < side) {
+                add_route(bench_quiet, v, v + 1, 1 + bench_below(BENCH_MAX_LATENCY));
+                add_route(bench_quiet, v + 1, v, 1 + bench_below(BENCH_MAX_LATENCY));
+            }
+            if (row + 1 < side) {
+                add_route(bench_quiet, v, v + side, 1 + bench_below(BENCH_MAX_LATENCY));
+                add_route(bench_quiet, v + side, v, 1 + bench_below(BENCH_MAX_LATENCY));
+            }
+        }
+    }
+}
+
+// Barabasi-Albert preferential attachment: every new computer links both
+// ways to BENCH_SCALE_FREE_LINKS distinct computers drawn by degree.
+static void bench_scale_free(long edges) {
+    int links = BENCH_SCALE_FREE_LINKS;
+    int n = (int)(edges / (2 * links));
+    if (n < links + 1) n = links + 1;
+    bench_add_computers(n);
+
+    // Every route endpoint once, so a uniform pick is a pick by degree
+    int* endpoints = malloc((size_t)n * links * 2 * sizeof(int));
+    int endpointCount = 0;
+    for (int u = 0; u <= links; u++) {
+        for (int v = u + 1; v <= links; v++) {
+            add_route(bench_quiet, u, v, 1 + bench_below(BENCH_MAX_LATENCY));
+            add_route(bench_quiet, v, u, 1 + bench_below(BENCH_MAX_LATENCY));
+            endpoints[endpointCount++] = u;
+            endpoints[endpointCount++] = v;
+        }
+    }
+    int chosen[BENCH_SCALE_FREE_LINKS];
+    for (int v = links + 1; v < n; v++) {
+        for (int k = 0; k < links; k++) {
+            bool repeated;
+            do {
+                chosen[k] = endpoints[bench_below(endpointCount)];
+                repeated = false;
+                for (int j = 0; j < k; j++) {
+                    if (chosen[j] == chosen[k]) repeated = true;
+                }
+            } while (repeated);
+        }
+        for (int k = 0; k < links; k++) {
+            add_route(bench_quiet, v, chosen[k], 1 + bench_below(BENCH_MAX_LATENCY));
+            add_route(bench_quiet, chosen[k], v, 1 + bench_below(BENCH_MAX_LATENCY));
+            endpoints[endpointCount++] = v;
+            endpoints[endpointCount++] = chosen[k];
+        }
+    }
+    free(endpoints);
+}
+
+// Random sparse network with one planted cycle of BENCH_CYCLE_LENGTH
+// computers whose latencies add up to -1.
+static void bench_negative_cycle(long edges) {
+    int n = (int)(edges / 4);
+    if (n < BENCH_CYCLE_LENGTH) n = BENCH_CYCLE_LENGTH;
+    bench_add_computers(n);
+    bench_random_routes(n, edges - BENCH_CYCLE_LENGTH);
+
+    int first = bench_below(n - BENCH_CYCLE_LENGTH + 1);
+    for (int i = 0; i < BENCH_CYCLE_LENGTH - 1; i++) {
+        add_route(bench_quiet, first + i, first + i + 1, BENCH_MAX_LATENCY);
+    }
+    add_route(bench_quiet, first + BENCH_CYCLE_LENGTH - 1, first, -(BENCH_CYCLE_LENGTH - 1) * BENCH_MAX_LATENCY - 1);
+}
+
+static void bench_generate(int topology, long edges) {
+    if (topology == TOPOLOGY_RANDOM) {
+        int n = (int)(edges / 4);
+        if (n < 2) n = 2;
+        bench_add_computers(n);
+        bench_random_routes(n, edges);
+    } else if (topology == TOPOLOGY_GRID) {
+        bench_grid(edges);
+    } else if (topology == TOPOLOGY_SCALE_FREE) {
+        bench_scale_free(edges);
+    } else {
+        bench_negative_cycle(edges);
+    }
+    graph_compact();
+}
+
+// One repetition on a freshly generated network: the build, then every
+// engine that applies, queried between random pairs of computers. Full-tree
+// engines run from the first `trees` sources only.
+// Work shared by the reader threads of the view_queries phases.
+typedef struct {
+    const int* sources;
+    const int* targets;
+    int queries;
+    atomic_int running;
+} BenchViewReaders;
+
+BenchViewReaders bench_view;
+
+// Answers every query pair BENCH_VIEW_PASSES times, each on whatever view is
+// current when it starts.
+static void* bench_view_reader(void* arg) {
+    (void)arg;
+    int capacity = 0;
+    int* distance = NULL;
+    int* previous = NULL;
+    for (int i = 0; i < bench_view.queries * BENCH_VIEW_PASSES; i++) {
+        const GraphView* view = view_pin();
+        if (view->nodes > capacity) {
+            capacity = view->nodes;
+            distance = grow_array(distance, capacity, sizeof(int));
+            previous = grow_array(previous, capacity, sizeof(int));
+        }
+        int q = i % bench_view.queries;
+        view_search(view, bench_view.sources[q], bench_view.targets[q], distance, previous);
+        view_unpin();
+    }
+    free(distance);
+    free(previous);
+    atomic_fetch_sub(&bench_view.running, 1);
+    return NULL;
+}
+
+// Runs the view readers on `readers` threads while this thread keeps adding
+// and removing routes and publishing a view after each change. Returns the
+// wall time until the readers are done.
+static double bench_view_queries(int topology, long edges, int readers) {
+    pthread_t* threads = malloc(readers * sizeof(pthread_t));
+    atomic_store(&bench_view.running, readers);
+    double started = bench_now();
+    for (int t = 0; t < readers; t++) {
+        pthread_create(&threads[t], NULL, bench_view_reader, NULL);
+    }
+    while (atomic_load(&bench_view.running) > 0) {
+        int u = bench_below(nodes);
+        int v = bench_below(nodes);
+        add_route(bench_quiet, u, v, 1 + bench_below(BENCH_MAX_LATENCY));
+        remove_route(bench_quiet, u, v);
+        double changed = bench_now();
+        view_publish();
+        bench_record(topology, edges, "view_publish", 1, bench_now() - changed);
+    }
+    double elapsed = bench_now() - started;
+    for (int t = 0; t < readers; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    return elapsed;
+}
+
+static bool bench_run(int topology, long edges, int queries, int trees) {
+    clear_network(bench_quiet);
+    double started = bench_now();
+    bench_generate(topology, edges);
+    int routes = 0;
+    for (int u = 0; u < nodes; u++) {
+        routes += graph.ends[u] - graph.offsets[u];
+    }
+    bench_record(topology, edges, "build", routes, bench_now() - started);
+
+    int* sources = malloc(queries * sizeof(int));
+    int* targets = malloc(queries * sizeof(int));
+    for (int q = 0; q < queries; q++) {
+        sources[q] = bench_below(nodes);
+        targets[q] = bench_below(nodes);
+    }
+    int* distance = malloc(nodes * sizeof(int));
+    int* previous = malloc(nodes * sizeof(int));
+    int* path = malloc(nodes * sizeof(int));
+    bool* affected = malloc(nodes * sizeof(bool));
+    int* cycle = malloc(nodes * sizeof(int));
+    int cycleLength, length, settled;
+
+    if (!has_negative_weights()) {
+        for (int q = 0; q < queries; q++) {
+            started = bench_now();
+            dijkstra_search(sources[q], targets[q], distance, previous);
+            bench_record(topology, edges, "dijkstra", 1, bench_now() - started);
+        }
+        for (int q = 0; q < queries; q++) {
+            started = bench_now();
+            bidirectional_search(sources[q], targets[q], distance, previous);
+            bench_record(topology, edges, "bidirectional", 1, bench_now() - started);
+        }
+
+        started = bench_now();
+        ensure_landmarks();
+        bench_record(topology, edges, "landmarks", 1, bench_now() - started);
+        for (int q = 0; q < queries; q++) {
+            started = bench_now();
+            astar_search(sources[q], targets[q], distance, previous);
+            bench_record(topology, edges, "astar", 1, bench_now() - started);
+        }
+
+        started = bench_now();
+        ensure_potentials();
+        bench_record(topology, edges, "potentials", 1, bench_now() - started);
+        for (int q = 0; q < queries; q++) {
+            started = bench_now();
+            johnson_search(sources[q], targets[q], distance, previous);
+            bench_record(topology, edges, "johnson", 1, bench_now() - started);
+        }
+
+        // Contraction slows down sharply on large random networks
+        if (routes <= bench_slow_routes) {
+            started = bench_now();
+            build_hierarchy(bench_quiet);
+            bench_record(topology, edges, "hierarchy_build", 1, bench_now() - started);
+            for (int q = 0; q < queries; q++) {
+                started = bench_now();
+                hierarchy_search(sources[q], targets[q], path, &length, &settled);
+                bench_record(topology, edges, "hierarchy", 1, bench_now() - started);
+            }
+        }
+
+        int delta = delta_stepping_width();
+        for (int q = 0; q < trees; q++) {
+            started = bench_now();
+            parallel_sssp(sources[q], delta, distance, previous, affected);
+            bench_record(topology, edges, "delta_stepping", 1, bench_now() - started);
+        }
+    }
+
+    for (int q = 0; q < trees; q++) {
+        started = bench_now();
+        spfa_search(sources[q], distance, previous, affected, cycle, &cycleLength);
+        bench_record(topology, edges, "bellman_ford", 1, bench_now() - started);
+    }
+    // Around a negative cycle the frontier engine needs a round per computer
+    for (int q = 0; q < trees && (!has_negative_weights() || routes <= bench_slow_routes); q++) {
+        started = bench_now();
+        parallel_sssp(sources[q], 0, distance, previous, affected);
+        bench_record(topology, edges, "parallel_bellman_ford", 1, bench_now() - started);
+    }
+
+    started = bench_now();
+    bool found = spfa_search(-1, distance, previous, affected, cycle, &cycleLength);
+    bench_record(topology, edges, "cycle_detection", 1, bench_now() - started);
+
+    if (!has_negative_weights()) {
+        int count = queries * 4;
+        started = bench_now();
+        for (int i = 0; i < count; i++) {
+            transfer_submit(bench_quiet, bench_below(nodes), bench_below(nodes), 1 + bench_below(16));
+        }
+        transfer_wait_idle();
+        simulate_transfers(bench_quiet);
+        bench_record(topology, edges, "transfer", count, bench_now() - started);
+
+        // Read throughput on published views, alone and on every worker,
+        // while routes keep changing
+        view_publish();
+        bench_view.sources = sources;
+        bench_view.targets = targets;
+        bench_view.queries = queries;
+        bench_record(topology, edges, "view_queries", queries * BENCH_VIEW_PASSES,
+                     bench_view_queries(topology, edges, 1));
+        if (worker_threads > 1) {
+            bench_record(topology, edges, "view_queries_mt", worker_threads * queries * BENCH_VIEW_PASSES,
+                         bench_view_queries(topology, edges, worker_threads));
+        }
+    }
+
+    free(sources);
+    free(targets);
+    free(distance);
+    free(previous);
+    free(path);
+    free(affected);
+    free(cycle);
+    return found == (topology == TOPOLOGY_NEGATIVE_CYCLE);
+}
+
+static void bench_print(long edges, int topology) {
+    bool header = false;
+    for (int i = 0; i < bench_count; i++) {
+        BenchResult* result = &bench_results[i];
+        if (result->edges != edges || strcmp(result->topology, topology_names[topology]) != 0) continue;
+        if (!header) {
+            printf("\n%s, %ld edges: %d computers, %d routes\n", result->topology, edges, result->nodes,
+                   result->routes);
+            printf("  %-22s %7s %10s %10s %10s %10s %10s %12s\n", "phase", "samples", "mean ms", "p50 ms",
+                   "p90 ms", "p99 ms", "max ms", "ops/s");
+            header = true;
+        }
+        BenchSummary summary = bench_summarize(result);
+        double rate = summary.mean > 0 ? result->items / (summary.mean / 1000.0) : 0;
+        printf("  %-22s %7d %10.3f %10.3f %10.3f %10.3f %10.3f %12.0f\n", summary.phase, summary.samples,
+               summary.mean, summary.p50, summary.p90, summary.p99, summary.max, rate);
+    }
+}
+
+// One result per line, which is also what bench_load() expects back.
+static bool bench_write_json(const char* path, uint64_t seed, int repeat, int queries) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Cannot write %s.\n", path);
+        return false;
+    }
+    fprintf(file, "{\n  \"seed\": %llu,\n  \"repeat\": %d,\n  \"queries\": %d,\n  \"threads\": %d,\n",
+            (unsigned long long)seed, repeat, queries, worker_threads);
+    fprintf(file, "  \"results\": [\n");
+    for (int i = 0; i < bench_count; i++) {
+        BenchResult* result = &bench_results[i];
+        BenchSummary summary = bench_summarize(result);
+        double rate = summary.mean > 0 ? result->items / (summary.mean / 1000.0) : 0;
+        fprintf(file, "    {\"topology\": \"%s\", \"edges\": %ld, \"phase\": \"%s\", \"samples\": %d, "
+                "\"mean_ms\": %.6f, \"p50_ms\": %.6f, \"p90_ms\": %.6f, \"p99_ms\": %.6f, \"max_ms\": %.6f, "
+                "\"nodes\": %d, \"routes\": %d, \"ops_per_s\": %.1f}%s\n",
+                summary.topology, summary.edges, summary.phase, summary.samples, summary.mean, summary.p50,
+                summary.p90, summary.p99, summary.max, result->nodes, result->routes, rate,
+                i + 1 < bench_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    bool written = fclose(file) == 0;
+    if (written) printf("\nResults written to %s.\n", path);
+    return written;
+}
+
+static int bench_load(const char* path, BenchSummary** summaries) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("Cannot read %s.\n", path);
+        return -1;
+    }
+    int count = 0, capacity = 0;
+    *summaries = NULL;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        BenchSummary summary;
+        memset(&summary, 0, sizeof(summary));
+        int fields = sscanf(line, " {\"topology\": \"%15[^\"]\", \"edges\": %ld, \"phase\": \"%31[^\"]\", "
+                            "\"samples\": %d, \"mean_ms\": %lf, \"p50_ms\": %lf, \"p90_ms\": %lf, "
+                            "\"p99_ms\": %lf, \"max_ms\": %lf",
+                            summary.topology, &summary.edges, summary.phase, &summary.samples, &summary.mean,
+                            &summary.p50, &summary.p90, &summary.p99, &summary.max);
+        if (fields != 9) continue;
+        if (count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 32;
+            *summaries = grow_array(*summaries, capacity, sizeof(BenchSummary));
+        }
+        (*summaries)[count++] = summary;
+    }
+    fclose(file);
+    if (count == 0) printf("%s holds no benchmark results.\n", path);
+    return count;
+}
+
+// Compares medians phase by phase. A phase regressed when its median grew
+// by more than threshold percent and by more than timer noise. Returns the
+// number of regressions.
+static int bench_compare(const BenchSummary* before, int beforeCount, const BenchSummary* after,
+                         int afterCount, double threshold) {
+    int regressions = 0, matched = 0;
+    printf("%-10s %9s %-22s %12s %12s %9s\n", "topology", "edges", "phase", "base p50 ms", "new p50 ms", "change");
+    for (int i = 0; i < afterCount; i++) {
+        const BenchSummary* now = &after[i];
+        const BenchSummary* base = NULL;
+        for (int j = 0; j < beforeCount; j++) {
+            if (before[j].edges == now->edges && strcmp(before[j].topology, now->topology) == 0 &&
+                strcmp(before[j].phase, now->phase) == 0) {
+                base = &before[j];
+                break;
+            }
+        }
+        if (!base) continue;
+        matched++;
+        double change = base->p50 > 0 ? (now->p50 - base->p50) / base->p50 * 100.0 : 0;
+        bool regressed = change > threshold && now->p50 - base->p50 > BENCH_NOISE_MS;
+        if (regressed) regressions++;
+        printf("%-10s %9ld %-22s %12.3f %12.3f %+8.1f%%%s\n", now->topology, now->edges, now->phase,
+               base->p50, now->p50, change, regressed ? "  REGRESSION" : "");
+    }
+    printf("%d phases compared, %d regressed by more than %.1f%%.\n", matched, regressions, threshold);
+    return regressions;
+}
+
+static void bench_usage(const char* program) {
+    printf("Usage: %s [--topology random|grid|scalefree|cycle|all] [--edges N[,N...]] [--seed S]\n", program);
+    printf("       %*s [--repeat R] [--queries Q] [--slow-limit ROUTES] [--json FILE]\n", (int)strlen(program), "");
+    printf("       %*s [--baseline FILE] [--threshold PCT]\n", (int)strlen(program), "");
+    printf("       %s --compare BASE.json NEW.json [--threshold PCT]\n", program);
+}
+
+int main(int argc, char** argv) {
+    initialize_graph();
+    configure_worker_threads();
+    quiet = true;
+
+    const char* topologyName = "all";
+    const char* edgeList = BENCH_DEFAULT_EDGES;
+    const char* jsonPath = NULL;
+    const char* baselinePath = NULL;
+    const char* comparePaths[2] = {NULL, NULL};
+    uint64_t seed = 1;
+    int repeat = 3;
+    int queries = 16;
+    double threshold = 20.0;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--topology") == 0 && hasValue) {
+            topologyName = argv[++i];
+        } else if (strcmp(argv[i], "--edges") == 0 && hasValue) {
+            edgeList = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--repeat") == 0 && hasValue) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--queries") == 0 && hasValue) {
+            queries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && hasValue) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+            baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "--slow-limit") == 0 && hasValue) {
+            bench_slow_routes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threshold") == 0 && hasValue) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            comparePaths[0] = argv[++i];
+            comparePaths[1] = argv[++i];
+        } else {
+            bench_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (comparePaths[0]) {
+        BenchSummary* before;
+        BenchSummary* after;
+        int beforeCount = bench_load(comparePaths[0], &before);
+        int afterCount = bench_load(comparePaths[1], &after);
+        if (beforeCount <= 0 || afterCount <= 0) return 2;
+        return bench_compare(before, beforeCount, after, afterCount, threshold) > 0 ? 1 : 0;
+    }
+
+    int first = 0, last = TOPOLOGIES - 1;
+    if (strcmp(topologyName, "all") != 0) {
+        for (first = 0; first < TOPOLOGIES; first++) {
+            if (strcmp(topologyName, topology_names[first]) == 0) break;
+        }
+        if (first == TOPOLOGIES) {
+            bench_usage(argv[0]);
+            return 2;
+        }
+        last = first;
+    }
+    if (repeat < 1) repeat = 1;
+    if (queries < 1) queries = 1;
+    int trees = queries / 4 > 0 ? queries / 4 : 1;
+    bench_quiet = fopen("/dev/null", "w");
+    if (!bench_quiet) {
+        printf("Cannot open /dev/null.\n");
+        return 2;
+    }
+
+    printf("Seed %llu, %d repetitions, %d queries, %d worker threads\n", (unsigned long long)seed, repeat,
+           queries, worker_threads);
+    bench_state = seed;
+    bool failed = false;
+    for (const char* cursor = edgeList; *cursor;) {
+        char* end;
+        long edges = strtol(cursor, &end, 10);
+        if (end == cursor || edges < BENCH_MIN_EDGES || edges > BENCH_MAX_EDGES) {
+            printf("Edge counts must be between %d and %d.\n", BENCH_MIN_EDGES, BENCH_MAX_EDGES);
+            return 2;
+        }
+        cursor = *end == ',' ? end + 1 : end;
+
+        for (int topology = first; topology <= last; topology++) {
+            for (int r = 0; r < repeat; r++) {
+                bool expected = bench_run(topology, edges, queries, trees);
+                if (!expected) {
+                    printf("%s, %ld edges: cycle detection gave the wrong answer.\n", topology_names[topology],
+                           edges);
+                    failed = true;
+                }
+            }
+            bench_print(edges, topology);
+        }
+    }
+    transfer_shutdown();
+
+    if (jsonPath && !bench_write_json(jsonPath, seed, repeat, queries)) failed = true;
+    if (baselinePath) {
+        BenchSummary* before;
+        int beforeCount = bench_load(baselinePath, &before);
+        if (beforeCount <= 0) return 2;
+        BenchSummary* after = malloc(bench_count * sizeof(BenchSummary));
+        for (int i = 0; i < bench_count; i++) {
+            after[i] = bench_summarize(&bench_results[i]);
+        }
+        printf("\nAgainst %s:\n", baselinePath);
+        if (bench_compare(before, beforeCount, after, bench_count, threshold) > 0) failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -1,24 +1,113 @@
 #include <stdio.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <windows.h>
 
 #define MAX_NODES 100
 #define FILE_SIZE 500
-
+#define PIPELINE_CHUNK 64
+#define PIPELINE_SLOTS 16
+#define SEGMENT_SIZE (64u << 20)
+#define MAX_SEGMENTS 1024
+#define COPY_CHUNK (1 << 20)
+#define SLAB_EDGES 4096
+
+// Routes are undirected, so every edge has a twin in its destination's
+// list. The twins form the in-edge index: the edges arriving at u are the
+// twins of u's own edges, and link lets either one be unlinked in O(1).
 typedef struct Edge {
     int destination;
     int weight;
     struct Edge* next;
+    struct Edge** link;     // the pointer that points at this edge
+    struct Edge* twin;
 } Edge;
 
+// Edges are carved out of slabs of SLAB_EDGES. Deleted edges go on a free
+// list for reuse; clearing the network releases whole slabs at once.
+typedef struct EdgeSlab {
+    struct EdgeSlab* next;
+    int used;
+    Edge edges[SLAB_EDGES];
+} EdgeSlab;
+
+typedef struct {
+    EdgeSlab* slabs;        // newest first; only the newest has unused slots
+    Edge* free_list;        // linked through next
+    int slab_count;
+    long long live;
+    long long free_count;
+} EdgeArena;
+
 Edge* graph[MAX_NODES];
-int sent_packets[MAX_NODES] = {0};
-int received_packets[MAX_NODES] = {0};
+EdgeArena edge_arena;
+long long sent_packets[MAX_NODES] = {0};
+long long received_packets[MAX_NODES] = {0};
 int nodes = 0;
 
+// Every computer's data lives in one append-only log split into mapped
+// segment files. A record is a RecordHeader followed by its payload.
+typedef struct {
+    int computer;       // whose data the payload belongs to
+    int sender;
+    int receiver;
+    unsigned length;
+    long long offset;   // position of the payload in the computer's data
+} RecordHeader;
+
+typedef struct {
+    char* data;
+    unsigned used;          // bytes written, headers included
+    long long payload;      // payload bytes written
+    long long live;         // payload bytes still indexed
+    HANDLE file;
+    HANDLE mapping;
+} Segment;
+
+typedef struct {
+    Segment segments[MAX_SEGMENTS];
+    int active;             // segment taking appends, -1 if none
+    long long live;
+    long long total;
+} Storage;
+
+// A computer's data is the concatenation of its extents, in order.
+typedef struct {
+    int segment;
+    unsigned position;      // payload start within the segment
+    unsigned length;
+} Extent;
+
+typedef struct {
+    Extent* extents;
+    int count;
+    int capacity;
+    long long size;
+} ComputerIndex;
+
+Storage storage = {.active = -1};
+// Pipeline stages read and append on their own threads; reads share the
+// lock, appends, deletes and compaction take it exclusively.
+SRWLOCK storage_lock = SRWLOCK_INIT;
+ComputerIndex computer_index[MAX_NODES];
+
+// Which computers can reach each other. Routes are undirected, so the
+// strongly connected components are the connected components and their
+// condensation has no edges; a union-find over the computers is the whole
+// index. Added routes are merged in place, while removals only mark the
+// index stale and the next query rebuilds it from the edge lists.
+typedef struct {
+    int parent[MAX_NODES];
+    int size[MAX_NODES];
+    bool stale;
+} ReachIndex;
+
+ReachIndex reach_index;
+
 const char* sampleText =
     "In Dijkstra’s Algorithm, the goal is to find the shortest distance from a given source node to all other nodes in the graph. As the source node is the starting point, its distance is initialized to zero. From there, we iteratively pick the unprocessed node with the minimum distance from the source, this is where a min-heap (priority queue) or a set is typically used for efficiency. For each picked node u, we update the distance to its neighbors v using the formula: dist[v] = dist[u] + weight[u][v], but only if this new path offers a shorter distance than the current known one. This process continues until all nodes have been processed."
     "Step-by-Step Implementation"
@@ -36,33 +125,383 @@ const char* sampleText =
 void initialize_graph() {
     for (int i = 0; i < MAX_NODES; i++) {
         graph[i] = NULL;
+        reach_index.parent[i] = i;
+        reach_index.size[i] = 1;
+    }
+}
+
+int reach_find(int v) {
+    while (reach_index.parent[v] != v) {
+        reach_index.parent[v] = reach_index.parent[reach_index.parent[v]];
+        v = reach_index.parent[v];
     }
+    return v;
 }
 
-void create_computer_file(int index) {
-    char filename[20];
-    sprintf(filename, "computer%d.txt", index);
-    FILE* file = fopen(filename, "w");
-    if (file) {
-        for (int i = 0; i < FILE_SIZE;) {
-            int len = strlen(sampleText);
-            int toWrite = (FILE_SIZE - i) < len ? (FILE_SIZE - i) : len;
-            fwrite(sampleText, sizeof(char), toWrite, file);
-            i += toWrite;
+void reach_union(int u, int v) {
+    u = reach_find(u);
+    v = reach_find(v);
+    if (u == v) return;
+    if (reach_index.size[u] < reach_index.size[v]) {
+        int swap = u;
+        u = v;
+        v = swap;
+    }
+    reach_index.parent[v] = u;
+    reach_index.size[u] += reach_index.size[v];
+}
+
+void reach_rebuild() {
+    for (int i = 0; i < nodes; i++) {
+        reach_index.parent[i] = i;
+        reach_index.size[i] = 1;
+    }
+    for (int u = 0; u < nodes; u++) {
+        for (Edge* edge = graph[u]; edge; edge = edge->next) {
+            if (edge->destination > u) reach_union(u, edge->destination);
         }
-        fclose(file);
     }
+    reach_index.stale = false;
 }
 
-void delete_computer_file(int index) {
-    char filename[20];
-    sprintf(filename, "computer%d.txt", index);
+// Maps segment slot `slot` as a fresh, zeroed SEGMENT_SIZE file.
+bool map_segment(int slot) {
+    Segment* segment = &storage.segments[slot];
+    char filename[32];
+    sprintf(filename, "storage%04d.seg", slot);
+    segment->file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (segment->file == INVALID_HANDLE_VALUE) return false;
+    segment->mapping = CreateFileMappingA(segment->file, NULL, PAGE_READWRITE, 0, SEGMENT_SIZE, NULL);
+    segment->data = segment->mapping ? (char*)MapViewOfFile(segment->mapping, FILE_MAP_ALL_ACCESS, 0, 0, SEGMENT_SIZE) : NULL;
+    if (segment->data == NULL) {
+        if (segment->mapping) CloseHandle(segment->mapping);
+        CloseHandle(segment->file);
+        remove(filename);
+        return false;
+    }
+    segment->used = 0;
+    segment->live = 0;
+    segment->payload = 0;
+    return true;
+}
+
+void unmap_segment(int slot) {
+    Segment* segment = &storage.segments[slot];
+    char filename[32];
+    sprintf(filename, "storage%04d.seg", slot);
+    UnmapViewOfFile(segment->data);
+    CloseHandle(segment->mapping);
+    CloseHandle(segment->file);
     remove(filename);
+    storage.live -= segment->live;
+    storage.total -= segment->payload;
+    segment->data = NULL;
+    if (storage.active == slot) storage.active = -1;
+}
+
+// Makes a free slot the active segment; false when every slot is in use.
+bool open_segment() {
+    for (int slot = 0; slot < MAX_SEGMENTS; slot++) {
+        if (storage.segments[slot].data == NULL) {
+            if (!map_segment(slot)) return false;
+            storage.active = slot;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends length bytes to the content of computer as one or more records.
+// A write that directly follows the computer's previous record for the
+// same sender and receiver extends that record instead of adding one.
+// The caller holds storage_lock exclusively.
+bool append_content(int computer, int sender, int receiver, const char* data, long long length) {
+    ComputerIndex* index = &computer_index[computer];
+    while (length > 0) {
+        Segment* segment = storage.active >= 0 ? &storage.segments[storage.active] : NULL;
+        Extent* last = index->count > 0 ? &index->extents[index->count - 1] : NULL;
+        RecordHeader* header = NULL;
+        if (segment && last && last->segment == storage.active && last->position + last->length == segment->used) {
+            header = (RecordHeader*)(segment->data + last->position - sizeof(RecordHeader));
+            if (header->sender != sender || header->receiver != receiver) header = NULL;
+        }
+        // Records start 8-byte aligned so headers can be accessed in place
+        unsigned start = segment ? (segment->used + 7) & ~7u : 0;
+        if (!segment || (header ? segment->used == SEGMENT_SIZE : start + sizeof(RecordHeader) >= SEGMENT_SIZE)) {
+            if (!open_segment()) {
+                printf("Error: Storage is full.\n");
+                return false;
+            }
+            continue;
+        }
+
+        if (!header) {
+            segment->used = start;
+            header = (RecordHeader*)(segment->data + segment->used);
+            header->computer = computer;
+            header->sender = sender;
+            header->receiver = receiver;
+            header->length = 0;
+            header->offset = index->size;
+            segment->used += sizeof(RecordHeader);
+            if (index->count == index->capacity) {
+                index->capacity = index->capacity > 0 ? index->capacity * 2 : 8;
+                index->extents = (Extent*)realloc(index->extents, index->capacity * sizeof(Extent));
+            }
+            last = &index->extents[index->count++];
+            last->segment = storage.active;
+            last->position = segment->used;
+            last->length = 0;
+        }
+
+        unsigned space = SEGMENT_SIZE - segment->used;
+        unsigned piece = length < space ? (unsigned)length : space;
+        memcpy(segment->data + segment->used, data, piece);
+        segment->used += piece;
+        segment->live += piece;
+        segment->payload += piece;
+        header->length += piece;
+        last->length += piece;
+        index->size += piece;
+        storage.live += piece;
+        storage.total += piece;
+        data += piece;
+        length -= piece;
+    }
+    return true;
+}
+
+bool storage_append(int computer, int sender, int receiver, const char* data, long long length) {
+    AcquireSRWLockExclusive(&storage_lock);
+    bool appended = append_content(computer, sender, receiver, data, length);
+    ReleaseSRWLockExclusive(&storage_lock);
+    return appended;
+}
+
+// Reads up to length bytes of a computer's content from offset into
+// buffer and returns the number of bytes read.
+long long storage_read(int computer, long long offset, char* buffer, long long length) {
+    ComputerIndex* index = &computer_index[computer];
+    long long copied = 0;
+    long long start = 0;
+    AcquireSRWLockShared(&storage_lock);
+    for (int i = 0; i < index->count && copied < length; i++) {
+        Extent extent = index->extents[i];
+        if (offset < start + extent.length) {
+            long long skip = offset > start ? offset - start : 0;
+            long long piece = extent.length - skip;
+            if (piece > length - copied) piece = length - copied;
+            memcpy(buffer + copied, storage.segments[extent.segment].data + extent.position + skip, piece);
+            copied += piece;
+            offset += piece;
+        }
+        start += extent.length;
+    }
+    ReleaseSRWLockShared(&storage_lock);
+    return copied;
+}
+
+// Appends the first length bytes of from's content to to's content,
+// straight from the mapped segments. from and to may be the same computer:
+// only bytes that existed before the copy are read. The lock is released
+// after every COPY_CHUNK bytes so pipeline readers are not held up by a
+// large copy.
+long long storage_copy(int from, long long length, int to, int sender, int receiver) {
+    long long copied = 0;
+    bool appended = true;
+    while (copied < length && appended) {
+        AcquireSRWLockExclusive(&storage_lock);
+        ComputerIndex* index = &computer_index[from];
+        if (length > index->size) length = index->size;
+        long long end = length - copied < COPY_CHUNK ? length : copied + COPY_CHUNK;
+        long long start = 0;
+        for (int i = 0; i < index->count && copied < end && appended; i++) {
+            Extent extent = index->extents[i];
+            if (copied < start + extent.length) {
+                long long skip = copied - start;
+                long long piece = extent.length - skip < end - copied ? extent.length - skip : end - copied;
+                appended = append_content(to, sender, receiver,
+                                          storage.segments[extent.segment].data + extent.position + skip, piece);
+                if (appended) copied += piece;
+            }
+            start += extent.length;
+        }
+        ReleaseSRWLockExclusive(&storage_lock);
+    }
+    return copied;
+}
+
+void create_computer_storage(int index) {
+    computer_index[index].count = 0;
+    computer_index[index].size = 0;
+    for (int i = 0; i < FILE_SIZE;) {
+        int len = strlen(sampleText);
+        int toWrite = (FILE_SIZE - i) < len ? (FILE_SIZE - i) : len;
+        if (!storage_append(index, index, index, sampleText, toWrite)) break;
+        i += toWrite;
+    }
+}
+
+// Forgets a computer's content; its records stay in the log as garbage
+// until the next compaction.
+void delete_computer_storage(int index) {
+    ComputerIndex* computer = &computer_index[index];
+    AcquireSRWLockExclusive(&storage_lock);
+    for (int i = 0; i < computer->count; i++) {
+        storage.segments[computer->extents[i].segment].live -= computer->extents[i].length;
+        storage.live -= computer->extents[i].length;
+    }
+    computer->count = 0;
+    computer->size = 0;
+    ReleaseSRWLockExclusive(&storage_lock);
+}
+
+// Rewrites the live records of every segment that is at least half garbage
+// into a fresh segment, then deletes those segments. If the store fills up
+// the compaction stops, and segments still holding live records are kept.
+// Returns the number of segments reclaimed.
+int storage_compact() {
+    bool victim[MAX_SEGMENTS];
+    int victims = 0;
+    AcquireSRWLockExclusive(&storage_lock);
+    for (int slot = 0; slot < MAX_SEGMENTS; slot++) {
+        Segment* segment = &storage.segments[slot];
+        victim[slot] = segment->data != NULL && segment->live * 2 <= segment->payload;
+        if (victim[slot]) victims++;
+    }
+    if (victims == 0) {
+        ReleaseSRWLockExclusive(&storage_lock);
+        return 0;
+    }
+    if (storage.active >= 0 && victim[storage.active]) storage.active = -1;
+
+    for (int c = 0; c < nodes; c++) {
+        ComputerIndex* index = &computer_index[c];
+        Extent* old = index->extents;
+        int count = index->count;
+        int capacity = index->capacity;
+        long long size = index->size;
+        bool moved = false;
+        for (int i = 0; i < count && !moved; i++) {
+            moved = victim[old[i].segment];
+        }
+        if (!moved) continue;
+
+        // Rebuild the extent list in order, copying only victim extents
+        index->extents = NULL;
+        index->count = 0;
+        index->capacity = 0;
+        index->size = 0;
+        int failed = -1;
+        for (int i = 0; i < count && failed < 0; i++) {
+            Segment* segment = &storage.segments[old[i].segment];
+            if (victim[old[i].segment]) {
+                RecordHeader* header = (RecordHeader*)(segment->data + old[i].position - sizeof(RecordHeader));
+                if (!append_content(c, header->sender, header->receiver, segment->data + old[i].position, old[i].length)) {
+                    failed = i;
+                    break;
+                }
+                segment->live -= old[i].length;
+                storage.live -= old[i].length;
+            } else {
+                if (index->count == index->capacity) {
+                    index->capacity = index->capacity > 0 ? index->capacity * 2 : 8;
+                    index->extents = (Extent*)realloc(index->extents, index->capacity * sizeof(Extent));
+                }
+                index->extents[index->count++] = old[i];
+                index->size += old[i].length;
+            }
+        }
+        if (failed >= 0) {
+            // Drop the partial copy and put the old extents back
+            for (int i = 0; i < index->count; i++) {
+                storage.segments[index->extents[i].segment].live -= index->extents[i].length;
+                storage.live -= index->extents[i].length;
+            }
+            for (int i = 0; i < failed; i++) {
+                storage.segments[old[i].segment].live += old[i].length;
+                storage.live += old[i].length;
+            }
+            free(index->extents);
+            index->extents = old;
+            index->count = count;
+            index->capacity = capacity;
+            index->size = size;
+            break;
+        }
+        free(old);
+    }
+
+    int reclaimed = 0;
+    for (int slot = 0; slot < MAX_SEGMENTS; slot++) {
+        if (victim[slot] && storage.segments[slot].live == 0) {
+            unmap_segment(slot);
+            reclaimed++;
+        }
+    }
+    ReleaseSRWLockExclusive(&storage_lock);
+    return reclaimed;
+}
+
+Edge* edge_alloc() {
+    Edge* edge = edge_arena.free_list;
+    if (edge) {
+        edge_arena.free_list = edge->next;
+        edge_arena.free_count--;
+    } else {
+        EdgeSlab* slab = edge_arena.slabs;
+        if (!slab || slab->used == SLAB_EDGES) {
+            slab = (EdgeSlab*)malloc(sizeof(EdgeSlab));
+            if (!slab) {
+                printf("Out of memory!\n");
+                exit(1);
+            }
+            slab->next = edge_arena.slabs;
+            slab->used = 0;
+            edge_arena.slabs = slab;
+            edge_arena.slab_count++;
+        }
+        edge = &slab->edges[slab->used++];
+    }
+    edge_arena.live++;
+    return edge;
+}
+
+void edge_free(Edge* edge) {
+    edge->next = edge_arena.free_list;
+    edge_arena.free_list = edge;
+    edge_arena.free_count++;
+    edge_arena.live--;
+}
+
+// Releases every edge at once; the caller drops all references to them.
+void edge_arena_reset() {
+    while (edge_arena.slabs) {
+        EdgeSlab* next = edge_arena.slabs->next;
+        free(edge_arena.slabs);
+        edge_arena.slabs = next;
+    }
+    edge_arena.free_list = NULL;
+    edge_arena.slab_count = 0;
+    edge_arena.live = 0;
+    edge_arena.free_count = 0;
+}
+
+void display_edge_arena() {
+    long long reserved = (long long)edge_arena.slab_count * sizeof(EdgeSlab);
+    long long carved = edge_arena.live + edge_arena.free_count;
+    printf("Edge slabs: %d (%lld bytes reserved)\n", edge_arena.slab_count, reserved);
+    printf("Live edges: %lld (%lld bytes)  Free list: %lld edges\n",
+           edge_arena.live, edge_arena.live * (long long)sizeof(Edge), edge_arena.free_count);
+    printf("Fragmentation: %.1f%% of carved edges are free\n",
+           carved > 0 ? 100.0 * edge_arena.free_count / carved : 0.0);
 }
 
 void add_computer() {
     if (nodes < MAX_NODES) {
-        create_computer_file(nodes);
+        create_computer_storage(nodes);
+        reach_index.parent[nodes] = nodes;
+        reach_index.size[nodes] = 1;
         nodes++;
         printf("Computer %d added to the network.\n", nodes - 1);
     } else {
@@ -70,30 +509,39 @@ void add_computer() {
     }
 }
 
-void remove_edges_to(int comp) {
-    for (int i = 0; i < nodes; i++) {
-        if (i == comp) continue;
-        Edge** current = &graph[i];
-        while (*current) {
-            if ((*current)->destination == comp) {
-                Edge* temp = *current;
-                *current = (*current)->next;
-                free(temp);
-            } else {
-                current = &(*current)->next;
-            }
-        }
+void link_edge(int u, Edge* edge) {
+    edge->next = graph[u];
+    if (graph[u]) graph[u]->link = &edge->next;
+    edge->link = &graph[u];
+    graph[u] = edge;
+}
+
+void unlink_edge(Edge* edge) {
+    *edge->link = edge->next;
+    if (edge->next) edge->next->link = edge->link;
+}
+
+// Drops every route of comp, visiting only the lists of its neighbours.
+void remove_edges_of(int comp) {
+    while (graph[comp]) {
+        Edge* edge = graph[comp];
+        unlink_edge(edge->twin);
+        edge_free(edge->twin);
+        graph[comp] = edge->next;
+        edge_free(edge);
     }
 }
 
 void remove_computer(int comp) {
     if (comp >= 0 && comp < nodes) {
-        delete_computer_file(comp);
-        free(graph[comp]);
-        graph[comp] = NULL;
+        delete_computer_storage(comp);
+        remove_edges_of(comp);
+        reach_index.stale = true;
         sent_packets[comp] = 0;
         received_packets[comp] = 0;
-        remove_edges_to(comp);
+        if ((storage.total - storage.live) * 2 > storage.total) {
+            storage_compact();
+        }
         printf("Computer %d removed from the network.\n", comp);
     } else {
         printf("Invalid computer index!\n");
@@ -101,18 +549,19 @@ void remove_computer(int comp) {
 }
 
 void add_route(int u, int v, int weight) {
-    if (u < nodes && v < nodes && u != v) {
-        Edge* newEdge = (Edge*)malloc(sizeof(Edge));
+    if (u >= 0 && v >= 0 && u < nodes && v < nodes && u != v) {
+        Edge* newEdge = edge_alloc();
         newEdge->destination = v;
         newEdge->weight = weight;
-        newEdge->next = graph[u];
-        graph[u] = newEdge;
+        link_edge(u, newEdge);
 
-        Edge* reverseEdge = (Edge*)malloc(sizeof(Edge));
+        Edge* reverseEdge = edge_alloc();
         reverseEdge->destination = u;
         reverseEdge->weight = weight;
-        reverseEdge->next = graph[v];
-        graph[v] = reverseEdge;
+        link_edge(v, reverseEdge);
+        newEdge->twin = reverseEdge;
+        reverseEdge->twin = newEdge;
+        reach_union(u, v);
 
         printf("Route added between %d and %d with latency %dms.\n", u, v, weight);
     } else {
@@ -130,36 +579,18 @@ void display_network() {
             printf("%d(%dms) ", temp->destination, temp->weight);
             temp = temp->next;
         }
-        printf("| Sent: %d | Received: %d\n", sent_packets[i], received_packets[i]);
+        printf("| Sent: %lld | Received: %lld\n", sent_packets[i], received_packets[i]);
     }
 }
 
+// Answered from the reachability index instead of a search per transfer.
 bool is_route_exists(int start, int end) {
-    bool visited[MAX_NODES] = {false};
-    int queue[MAX_NODES];
-    int front = 0, rear = 0;
-    queue[rear++] = start;
-    visited[start] = true;
-
-    while (front < rear) {
-        int current = queue[front++];
-        if (current == end) return true;
-
-        Edge* temp = graph[current];
-        while (temp) {
-            if (!visited[temp->destination]) {
-                visited[temp->destination] = true;
-                queue[rear++] = temp->destination;
-            }
-            temp = temp->next;
-        }
-    }
-    return false;
+    if (start < 0 || end < 0 || start >= nodes || end >= nodes) return false;
+    if (reach_index.stale) reach_rebuild();
+    return reach_find(start) == reach_find(end);
 }
 
-void dijkstra(int start, int end) {
-    int distance[MAX_NODES];
-    int previous[MAX_NODES];
+void shortest_path(int start, int* distance, int* previous) {
     bool visited[MAX_NODES];
 
     for (int i = 0; i < nodes; i++) {
@@ -177,7 +608,7 @@ void dijkstra(int start, int end) {
                 minIndex = v;
             }
         }
-        if (minIndex == -1) break;
+        if (minIndex == -1 || distance[minIndex] == INT_MAX) break;
         visited[minIndex] = true;
 
         Edge* temp = graph[minIndex];
@@ -190,6 +621,12 @@ void dijkstra(int start, int end) {
             temp = temp->next;
         }
     }
+}
+
+void dijkstra(int start, int end) {
+    int distance[MAX_NODES];
+    int previous[MAX_NODES];
+    shortest_path(start, distance, previous);
 
     if (distance[end] == INT_MAX) {
         printf("\nNo path found between %d and %d. Add a route first.\n", start, end);
@@ -206,11 +643,17 @@ void dijkstra(int start, int end) {
     printf("END\n");
 }
 
+typedef struct {
+    int from;
+    int to;
+    long long bytes;
+} TransferRequest;
+
 DWORD WINAPI data_transfer(LPVOID arg) {
-    int* params = (int*)arg;
-    int from = params[0];
-    int to = params[1];
-    int bytes = params[2];
+    TransferRequest* request = (TransferRequest*)arg;
+    int from = request->from;
+    int to = request->to;
+    long long bytes = request->bytes;
 
     if (!is_route_exists(from, to)) {
         printf("No route exists between %d and %d. Add a route first.\n", from, to);
@@ -220,56 +663,253 @@ DWORD WINAPI data_transfer(LPVOID arg) {
     sent_packets[from] += bytes;
     received_packets[to] += bytes;
 
-    char fromFile[20], toFile[20];
-    sprintf(fromFile, "computer%d.txt", from);
-    sprintf(toFile, "computer%d.txt", to);
+    // Only what the sender holds now is sent, even though its own log
+    // grows while the copy runs
+    long long length = computer_index[from].size;
+    if (bytes < length) length = bytes;
+
+    char header[64];
+    sprintf(header, "\nReceived from computer%d: ", from);
+    storage_append(to, from, to, header, strlen(header));
+    storage_copy(from, length, to, from, to);
+    storage_append(to, from, to, "\n", 1);
 
-    FILE* src = fopen(fromFile, "r");
-    FILE* dest = fopen(toFile, "a");
+    sprintf(header, "\nData sent to computer%d: ", to);
+    storage_append(from, from, to, header, strlen(header));
+    storage_copy(from, length, from, from, to);
+    storage_append(from, from, to, "\n", 1);
 
-    if (src && dest) {
-        char* buffer = (char*)malloc(bytes + 1);
-        fread(buffer, sizeof(char), bytes, src);
-        buffer[bytes] = '\0';
+    for (int i = 0; i <= 100; i += 20) {
+        printf("Data transfer: %d%%\n", i);
+        Sleep(30);
+    }
 
-        fprintf(dest, "\nReceived from computer%d: %s\n", from, buffer);
-        fclose(dest);
+    printf("Data transfer complete: %lld bytes sent from %d to %d.\n", bytes, from, to);
+    return 0;
+}
 
-        FILE* logSender = fopen(fromFile, "a");
-        if (logSender) {
-            fprintf(logSender, "\nData sent to computer%d: %s\n", to, buffer);
-            fclose(logSender);
+typedef struct {
+    int length;     // 0 marks the end of the stream
+    char data[PIPELINE_CHUNK];
+} Chunk;
+
+// Bounded single-producer/single-consumer ring between two adjacent hops.
+// Only the producer advances tail and only the consumer advances head.
+typedef struct {
+    Chunk slots[PIPELINE_SLOTS];
+    atomic_uint head;
+    atomic_uint tail;
+    int stalls;     // times the producer found the ring full
+} ChunkRing;
+
+// One computer on the path. The source reads its file into out, the
+// destination appends in to its file, and the computers between forward.
+typedef struct {
+    int node;
+    int from;
+    ChunkRing* in;
+    ChunkRing* out;
+    int bytes;
+    atomic_bool* cancelled;     // stops the source when a stage failed to start
+} PipelineStage;
+
+Chunk* ring_claim(ChunkRing* ring) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == PIPELINE_SLOTS) {
+        ring->stalls++;
+        while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == PIPELINE_SLOTS) {
+            Sleep(0);
         }
+    }
+    return &ring->slots[tail % PIPELINE_SLOTS];
+}
 
-        free(buffer);
-        fclose(src);
-    } else {
-        printf("Error: Could not open files for data transfer.\n");
+void ring_publish(ChunkRing* ring) {
+    atomic_fetch_add_explicit(&ring->tail, 1, memory_order_release);
+}
+
+Chunk* ring_peek(ChunkRing* ring) {
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+        Sleep(0);
     }
+    return &ring->slots[head % PIPELINE_SLOTS];
+}
 
-    for (int i = 0; i <= 100; i += 20) {
-        printf("Data transfer: %d%%\n", i);
-        Sleep(30);
+void ring_release(ChunkRing* ring) {
+    atomic_fetch_add_explicit(&ring->head, 1, memory_order_release);
+}
+
+DWORD WINAPI pipeline_stage(LPVOID arg) {
+    PipelineStage* stage = (PipelineStage*)arg;
+
+    if (stage->in == NULL) {
+        int left = stage->bytes;
+        stage->bytes = 0;
+        while (left > 0 && !atomic_load(stage->cancelled)) {
+            Chunk* chunk = ring_claim(stage->out);
+            int length = (int)storage_read(stage->node, stage->bytes, chunk->data, left < PIPELINE_CHUNK ? left : PIPELINE_CHUNK);
+            if (length <= 0) break;
+            chunk->length = length;
+            ring_publish(stage->out);
+            sent_packets[stage->node] += length;
+            stage->bytes += length;
+            left -= length;
+        }
+        ring_claim(stage->out)->length = 0;
+        ring_publish(stage->out);
+        return 0;
     }
 
-    printf("Data transfer complete: %d bytes sent from %d to %d.\n", bytes, from, to);
+    if (stage->out == NULL) {
+        char header[64];
+        sprintf(header, "\nReceived from computer%d: ", stage->from);
+        storage_append(stage->node, stage->from, stage->node, header, strlen(header));
+    }
+    while (1) {
+        Chunk* chunk = ring_peek(stage->in);
+        int length = chunk->length;
+        if (length == 0) {
+            ring_release(stage->in);
+            break;
+        }
+        received_packets[stage->node] += length;
+        if (stage->out) {
+            Chunk* next = ring_claim(stage->out);
+            memcpy(next, chunk, offsetof(Chunk, data) + length);
+            ring_publish(stage->out);
+            sent_packets[stage->node] += length;
+        } else {
+            storage_append(stage->node, stage->from, stage->node, chunk->data, length);
+        }
+        stage->bytes += length;
+        ring_release(stage->in);
+    }
+    if (stage->out) {
+        ring_claim(stage->out)->length = 0;
+        ring_publish(stage->out);
+    }
+    if (stage->out == NULL) {
+        storage_append(stage->node, stage->from, stage->node, "\n", 1);
+    }
     return 0;
 }
 
+// Streams a transfer hop by hop along the shortest path. Every computer on
+// the path runs as its own stage, connected to the next by a ChunkRing, so
+// chunks move through all hops at once and a slow hop backs up the rest.
+void pipelined_transfer(int from, int to, int bytes) {
+    if (from < 0 || to < 0 || from >= nodes || to >= nodes || from == to || bytes < 0) {
+        printf("Invalid computers!\n");
+        return;
+    }
+    int distance[MAX_NODES];
+    int previous[MAX_NODES];
+    shortest_path(from, distance, previous);
+    if (distance[to] == INT_MAX) {
+        printf("No route exists between %d and %d. Add a route first.\n", from, to);
+        return;
+    }
+
+    int path[MAX_NODES];
+    int hops = 0;
+    for (int current = to; current != from; current = previous[current]) {
+        hops++;
+    }
+    for (int current = to, i = hops; i >= 0; current = previous[current], i--) {
+        path[i] = current;
+    }
+
+    ChunkRing* rings = (ChunkRing*)calloc(hops, sizeof(ChunkRing));
+    if (!rings) {
+        printf("Out of memory!\n");
+        return;
+    }
+    PipelineStage stages[MAX_NODES];
+    HANDLE threads[MAX_NODES];
+    atomic_bool cancelled = false;
+    int running = 0;
+    LARGE_INTEGER frequency, started, finished;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&started);
+    for (int i = 0; i <= hops; i++) {
+        stages[i].node = path[i];
+        stages[i].from = from;
+        stages[i].in = i > 0 ? &rings[i - 1] : NULL;
+        stages[i].out = i < hops ? &rings[i] : NULL;
+        stages[i].bytes = i == 0 ? bytes : 0;
+        stages[i].cancelled = &cancelled;
+        threads[i] = CreateThread(NULL, 0, pipeline_stage, &stages[i], 0, NULL);
+        if (threads[i] == NULL) break;
+        running++;
+    }
+    if (running <= hops) {
+        // Stop the source and consume what the started stages still
+        // forward, so each of them sees the end of the stream and exits
+        atomic_store(&cancelled, true);
+        while (running > 0) {
+            Chunk* chunk = ring_peek(&rings[running - 1]);
+            int length = chunk->length;
+            ring_release(&rings[running - 1]);
+            if (length == 0) break;
+        }
+    }
+    for (int i = 0; i < running; i++) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+    if (running <= hops) {
+        printf("Error: Could not start the transfer stage on computer %d.\n", path[running]);
+        free(rings);
+        return;
+    }
+    QueryPerformanceCounter(&finished);
+
+    double seconds = (double)(finished.QuadPart - started.QuadPart) / frequency.QuadPart;
+    int moved = stages[hops].bytes;
+    printf("Pipelined transfer complete: %d bytes sent from %d to %d over %d hops.\n", moved, from, to, hops);
+    for (int i = 0; i < hops; i++) {
+        printf("Hop %d -> %d: %d bytes, %d backpressure stalls\n",
+               path[i], path[i + 1], stages[i + 1].bytes, rings[i].stalls);
+    }
+    printf("Elapsed: %.3fms (%.2f MB/s)\n", seconds * 1000, seconds > 0 ? moved / seconds / 1e6 : 0.0);
+
+    char logLine[96];
+    sprintf(logLine, "\nData sent to computer%d: %d bytes over %d hops\n", to, moved, hops);
+    storage_append(from, from, to, logLine, strlen(logLine));
+    free(rings);
+}
+
+// Prints the first bytes of a computer's data.
+void show_computer_data(int comp, int bytes) {
+    if (comp < 0 || comp >= nodes || bytes < 0) {
+        printf("Invalid computer index!\n");
+        return;
+    }
+    char buffer[4096];
+    long long offset = 0;
+    printf("Computer %d holds %lld bytes:\n", comp, computer_index[comp].size);
+    while (offset < bytes) {
+        long long want = bytes - offset < (long long)sizeof(buffer) ? bytes - offset : (long long)sizeof(buffer);
+        long long got = storage_read(comp, offset, buffer, want);
+        if (got <= 0) break;
+        fwrite(buffer, sizeof(char), got, stdout);
+        offset += got;
+    }
+    printf("\n");
+}
+
 void clear_network() {
     for (int i = 0; i < nodes; i++) {
-        delete_computer_file(i);
-        Edge* temp = graph[i];
-        while (temp) {
-            Edge* next = temp->next;
-            free(temp);
-            temp = next;
-        }
+        delete_computer_storage(i);
         graph[i] = NULL;
         sent_packets[i] = 0;
         received_packets[i] = 0;
     }
     nodes = 0;
+    reach_index.stale = false;
+    edge_arena_reset();
+    storage_compact();
     printf("Network cleared!\n");
 }
 
@@ -285,6 +925,10 @@ int main() {
         printf("6. Transfer Data\n");
         printf("7. Clear Network\n");
         printf("8. Exit\n");
+        printf("9. Pipelined Transfer\n");
+        printf("10. Show Computer Data\n");
+        printf("11. Compact Storage\n");
+        printf("12. Edge Allocator Statistics\n");
 
         int choice;
         printf("Enter your choice: ");
@@ -310,23 +954,34 @@ int main() {
             scanf("%d %d", &start, &end);
             dijkstra(start, end);
         } else if (choice == 6) {
-            int from, to, bytes;
+            TransferRequest request;
             printf("Enter source, destination, and bytes to send: ");
-            scanf("%d %d %d", &from, &to, &bytes);
-            int* params = (int*)malloc(3 * sizeof(int));
-            params[0] = from;
-            params[1] = to;
-            params[2] = bytes;
+            scanf("%d %d %lld", &request.from, &request.to, &request.bytes);
 
-            HANDLE thread = CreateThread(NULL, 0, data_transfer, params, 0, NULL);
+            HANDLE thread = CreateThread(NULL, 0, data_transfer, &request, 0, NULL);
             WaitForSingleObject(thread, INFINITE);
             CloseHandle(thread);
-            free(params);
         } else if (choice == 7) {
             clear_network();
         } else if (choice == 8) {
             printf("Exiting...\n");
             break;
+        } else if (choice == 9) {
+            int from, to, bytes;
+            printf("Enter source, destination, and bytes to send: ");
+            scanf("%d %d %d", &from, &to, &bytes);
+            pipelined_transfer(from, to, bytes);
+        } else if (choice == 10) {
+            int comp, bytes;
+            printf("Enter computer index and bytes to show: ");
+            scanf("%d %d", &comp, &bytes);
+            show_computer_data(comp, bytes);
+        } else if (choice == 11) {
+            int reclaimed = storage_compact();
+            printf("Storage compacted: %d segments reclaimed, %lld of %lld bytes live.\n",
+                   reclaimed, storage.live, storage.total);
+        } else if (choice == 12) {
+            display_edge_arena();
         } else {
             printf("Invalid choice!\n");
         }
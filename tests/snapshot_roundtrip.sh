@@ -0,0 +1,103 @@
+#!/bin/sh
+# Saves a snapshot after computers are added and removed, loads it back and
+# checks that the loaded network answers every path query the same way.
+# Usage: tests/snapshot_roundtrip.sh [path/to/dscp]
+
+dscp=${1:-./dscp}
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+failed=0
+
+# check NAME SETUP QUERIES: runs SETUP, saves, then runs QUERIES once on the
+# network in memory and once after clearing it and loading the snapshot.
+# Apart from the timed summary line the two outputs must match.
+check() {
+    printf '%s\nsave %s\n%s\n' "$2" "$work/net.snap" "$3" |
+        "$dscp" --batch - 2>&1 | grep -v '^Batch:' > "$work/direct.txt"
+    printf '%s\nsave %s\nclear\nload %s\n%s\n' "$2" "$work/net.snap" "$work/net.snap" "$3" |
+        "$dscp" --batch - 2>&1 | grep -v '^Batch:' > "$work/loaded.txt"
+    if cmp -s "$work/direct.txt" "$work/loaded.txt"; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        diff "$work/direct.txt" "$work/loaded.txt"
+        failed=1
+    fi
+}
+
+check "add after a query" \
+    "computer 3
+route 0 1 5
+route 1 2 5
+path 0 2
+computer" \
+    "path 0 2
+path 2 0
+path 0 3"
+
+check "remove after a query" \
+    "computer 4
+route 0 3 5
+route 2 3 5
+route 3 0 1
+path 0 3
+remove 1
+remove 2" \
+    "path 0 3
+path 3 0"
+
+check "reuse a removed slot" \
+    "computer 5
+route 0 1 2
+route 1 2 2
+route 2 3 2
+route 0 4 9
+route 4 3 1
+path 0 3
+remove 2
+computer
+route 3 4 4" \
+    "path 0 3
+path 3 0
+path 4 0"
+
+check "negative route" \
+    "computer 4
+route 0 1 4
+route 1 2 -2
+route 2 3 1
+remove 3" \
+    "path 0 2 2
+path 2 0 2"
+
+check "saved landmarks and potentials" \
+    "computer 6
+route 0 1 3
+route 1 2 4
+route 2 5 1
+route 0 3 2
+route 3 4 6
+route 4 5 1
+remove 1
+computer
+route 0 1 1
+route 1 2 1
+path 0 5 4
+path 0 5 8" \
+    "path 0 5 4
+path 3 5 4
+path 3 5 8
+path 5 0 4"
+
+check "potentials with a negative route" \
+    "computer 4
+route 0 1 5
+route 1 2 -3
+route 0 2 4
+route 2 3 2
+path 0 3 8" \
+    "path 1 3 8
+path 2 3 8
+path 0 3 2"
+
+exit $failed